@@ -3,6 +3,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <sys/wait.h>
 
 #include <gio/gio.h>
 #include <gio/gunixinputstream.h>
@@ -13,14 +14,26 @@ static GMainLoop *loop;
 static char *tmpdir;
 static char buffer[1];
 
+/* Exit status of docker run, which is what we exit with */
+static int run_status = 0;
+
+/* Where to report that the container has been created, or -1 */
+static int started_fd = -1;
+
 static void
 on_subprocess_exited (GObject       *source_object,
                       GAsyncResult *res,
                       gpointer      user_data)
 {
   GError *error = NULL;
-  g_subprocess_wait_finish (G_SUBPROCESS (source_object),
-                            res, &error);
+  GSubprocess *subprocess = G_SUBPROCESS (source_object);
+  if (g_subprocess_wait_finish (subprocess, res, &error))
+    {
+      if (g_subprocess_get_if_exited (subprocess))
+        run_status = g_subprocess_get_exit_status (subprocess);
+      else if (g_subprocess_get_if_signaled (subprocess))
+        run_status = 128 + g_subprocess_get_term_sig (subprocess);
+    }
   g_main_loop_quit (loop);
 }
 
@@ -29,6 +42,17 @@ on_host_command_exited (int      pid,
                         int      status,
                         gpointer user_data)
 {
+  /* user_data is set for docker run, not for docker rm */
+  if (user_data != NULL)
+    {
+      if (WIFEXITED (status))
+        run_status = WEXITSTATUS (status);
+      else if (WIFSIGNALED (status))
+        run_status = 128 + WTERMSIG (status);
+      else
+        run_status = 255;
+    }
+
   g_main_loop_quit (loop);
 }
 
@@ -49,6 +73,29 @@ on_input (GObject      *source_object,
   g_main_loop_quit (loop);
 }
 
+/* docker run writes the container ID to the cidfile, and closes it, right
+ * after creating the container; by then the volumes have been relabeled */
+static void
+on_tmpdir_changed (GFileMonitor      *monitor,
+                   GFile             *file,
+                   GFile             *other_file,
+                   GFileMonitorEvent  event_type,
+                   gpointer           user_data)
+{
+  if (event_type != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT || started_fd == -1)
+    return;
+
+  char *name = g_file_get_basename (file);
+  if (strcmp (name, "cid") == 0)
+    {
+      if (write (started_fd, "", 1) != 1)
+        g_printerr ("Can't report that the container started: %s\n", strerror (errno));
+      close (started_fd);
+      started_fd = -1;
+    }
+  g_free (name);
+}
+
 static void
 cleanup (void)
 {
@@ -73,12 +120,22 @@ main(int argc, char **argv)
 
   int first_arg = 1;
 
+  /* --pty: our stdin/stdout are a terminal that the container's TTY needs
+   * to be forwarded to; otherwise stdin/stdout/stderr are handed to
+   * 'docker run' as they are */
   if (argc > 1 && strcmp (argv[1], "--pty") == 0)
     {
       first_arg++;
       use_pty = TRUE;
     }
 
+  /* --started-fd=N: write a byte to N once the container has been created */
+  if (argc > first_arg && g_str_has_prefix (argv[first_arg], "--started-fd="))
+    {
+      started_fd = atoi (argv[first_arg] + strlen ("--started-fd="));
+      first_arg++;
+    }
+
   if (argc < first_arg + 1)
     {
       g_printerr ("First argument must be the file descriptor to wait on\n");
@@ -120,6 +177,18 @@ main(int argc, char **argv)
 
   char *cidfile = g_build_filename (tmpdir, "cid", NULL);
 
+  if (started_fd != -1)
+    {
+      GFile *dir = g_file_new_for_path (tmpdir);
+      GFileMonitor *monitor = g_file_monitor_directory (dir, G_FILE_MONITOR_NONE, NULL, &error);
+      if (!monitor)
+        {
+          g_printerr ("Can't monitor %s: %s\n", tmpdir, error->message);
+          goto fail;
+        }
+      g_signal_connect (monitor, "changed", G_CALLBACK (on_tmpdir_changed), NULL);
+    }
+
   GPtrArray *arg_array = g_ptr_array_new();
 
   g_ptr_array_add(arg_array, "docker");
@@ -132,6 +201,11 @@ main(int argc, char **argv)
   g_ptr_array_add (arg_array, NULL);
   char **subprocess_args = (char **)g_ptr_array_free (arg_array, FALSE);
 
+  /* For 'pegg profile': the wall-clock time when we start docker run,
+   * which can be compared to times from inside the container */
+  if (g_getenv ("PEGG_PROFILE") != NULL)
+    g_printerr ("pegg-profile: docker-run %" G_GINT64_FORMAT "\n", g_get_real_time ());
+
   GDBusConnection *connection = NULL;
   if (pegg_in_flatpak ())
     {
@@ -144,7 +218,7 @@ main(int argc, char **argv)
                                         subprocess_args,
                                         use_pty ? PEGG_HOST_COMMAND_USE_PTY : PEGG_HOST_COMMAND_NONE,
                                         on_host_command_exited,
-                                        NULL, NULL, &error);
+                                        GINT_TO_POINTER (TRUE), NULL, &error);
       if (pid == -1)
         {
           g_printerr ("Can't execute docker-run on host: %s\n", error->message);
@@ -216,7 +290,7 @@ main(int argc, char **argv)
     }
 
   cleanup();
-  return 0;
+  return run_status;
 
  fail:
   cleanup();
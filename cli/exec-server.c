@@ -0,0 +1,390 @@
+/* pegg-exec-server: runs as the entrypoint of a long-lived project
+ * container and executes commands on behalf of 'pegg run', so that
+ * running a command doesn't require creating a new container.
+ *
+ * This runs inside the container, so it doesn't use GLib and is linked
+ * statically where possible.
+ *
+ * Protocol, over a SOCK_STREAM unix socket:
+ *
+ *  client -> server: a 4 byte length in native byte order, sent together
+ *    with SCM_RIGHTS for the command's stdin, stdout and stderr, then that
+ *    many bytes of NUL-terminated strings: the working directory, zero or
+ *    more environment variables of the form NAME=VALUE, an empty string,
+ *    and then the arguments of the command.
+ *
+ *  client -> server: (optional, any time after the request) single bytes,
+ *    each a signal number to deliver to the command's process group.
+ *    If the client goes away, the process group gets SIGHUP.
+ *
+ *  server -> client: a 4 byte wait status in native byte order when the
+ *    command exits, or of exit status 127 if it couldn't be run, after
+ *    writing the reason to the command's stderr.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define MAX_REQUEST_SIZE (1024 * 1024)
+
+static const char *socket_path;
+
+static void
+on_terminate (int signum)
+{
+  (void) signum;
+
+  unlink (socket_path);
+  _exit (0);
+}
+
+static int
+read_all (int    fd,
+          char  *buffer,
+          size_t len)
+{
+  size_t count = 0;
+  while (count < len)
+    {
+      ssize_t n = read (fd, buffer + count, len - count);
+      if (n == -1 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return -1;
+      count += n;
+    }
+
+  return 0;
+}
+
+static int
+write_all (int         fd,
+           const char *buffer,
+           size_t      len)
+{
+  size_t count = 0;
+  while (count < len)
+    {
+      ssize_t n = write (fd, buffer + count, len - count);
+      if (n == -1 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return -1;
+      count += n;
+    }
+
+  return 0;
+}
+
+/* Receives the request header and the three standard FD's */
+static int
+receive_header (int       conn,
+                uint32_t *len,
+                int      *fds)
+{
+  char control[CMSG_SPACE (3 * sizeof (int))];
+  struct iovec iov = { .iov_base = len, .iov_len = sizeof (*len) };
+  struct msghdr msg = {
+    .msg_iov = &iov,
+    .msg_iovlen = 1,
+    .msg_control = control,
+    .msg_controllen = sizeof (control),
+  };
+
+  ssize_t n;
+  do
+    n = recvmsg (conn, &msg, MSG_CMSG_CLOEXEC);
+  while (n == -1 && errno == EINTR);
+
+  if (n != sizeof (*len))
+    return -1;
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR (&msg);
+  if (cmsg == NULL ||
+      cmsg->cmsg_level != SOL_SOCKET ||
+      cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN (3 * sizeof (int)))
+    return -1;
+
+  memcpy (fds, CMSG_DATA (cmsg), 3 * sizeof (int));
+
+  return 0;
+}
+
+static void
+exec_command (char  *cwd,
+              char **env,
+              char **argv,
+              int   *fds)
+{
+  setsid ();
+
+  /* Will fail unless the terminal is free to become our controlling
+   * terminal, which is fine; we just don't get job control */
+  if (isatty (fds[0]))
+    (void) ioctl (fds[0], TIOCSCTTY, 0);
+
+  for (int i = 0; i < 3; i++)
+    if (dup2 (fds[i], i) == -1)
+      _exit (127);
+
+  signal (SIGPIPE, SIG_DFL);
+
+  for (char **e = env; *e; e++)
+    putenv (*e);
+
+  if (chdir (cwd) == -1)
+    {
+      fprintf (stderr, "pegg-exec-server: Can't change to %s: %s\n", cwd, strerror (errno));
+      _exit (127);
+    }
+
+  execvp (argv[0], argv);
+  fprintf (stderr, "pegg-exec-server: Can't execute %s: %s\n", argv[0], strerror (errno));
+  _exit (127);
+}
+
+static void
+send_status (int conn,
+             int status)
+{
+  uint32_t reply = status;
+  if (write_all (conn, (char *)&reply, sizeof (reply)) == -1)
+    fprintf (stderr, "pegg-exec-server: Can't send exit status: %s\n", strerror (errno));
+}
+
+/* For when the command can't be run: tells the client why on its
+ * stderr, and replies with an exit status of 127, like the shell */
+static void
+send_error (int         conn,
+            int        *fds,
+            const char *message,
+            int         error)
+{
+  if (error != 0)
+    dprintf (fds[2], "pegg-exec-server: %s: %s\n", message, strerror (error));
+  else
+    dprintf (fds[2], "pegg-exec-server: %s\n", message);
+
+  send_status (conn, 127 << 8);
+}
+
+static void
+handle_connection (int conn)
+{
+  uint32_t len;
+  int fds[3];
+
+  if (receive_header (conn, &len, fds) == -1)
+    return;
+
+  if (len == 0 || len > MAX_REQUEST_SIZE)
+    {
+      send_error (conn, fds, "Invalid request", 0);
+      return;
+    }
+
+  char *request = malloc (len + 1);
+  if (request == NULL)
+    {
+      send_error (conn, fds, "Can't allocate request", errno);
+      return;
+    }
+  if (read_all (conn, request, len) == -1)
+    {
+      send_error (conn, fds, "Can't read request", errno);
+      return;
+    }
+  request[len] = '\0';
+
+  /* Split the request into the working directory, environment, and
+   * arguments; at most one pointer for each string, plus terminators */
+  char **strings = calloc (len + 2, sizeof (char *));
+  if (strings == NULL)
+    {
+      send_error (conn, fds, "Can't allocate request", errno);
+      return;
+    }
+  int n_strings = 0;
+  for (char *p = request; p < request + len; p += strlen (p) + 1)
+    strings[n_strings++] = p;
+
+  int separator = 1;
+  while (separator < n_strings && strings[separator][0] != '\0')
+    separator++;
+  if (separator + 1 >= n_strings)
+    {
+      send_error (conn, fds, "No command given", 0);
+      return;
+    }
+
+  char *cwd = strings[0];
+  char **env = strings + 1;
+  char **argv = strings + separator + 1;
+  strings[separator] = NULL;
+  strings[n_strings] = NULL;
+
+  sigset_t mask;
+  sigemptyset (&mask);
+  sigaddset (&mask, SIGCHLD);
+  sigprocmask (SIG_BLOCK, &mask, NULL);
+  int sfd = signalfd (-1, &mask, SFD_CLOEXEC);
+  if (sfd == -1)
+    {
+      send_error (conn, fds, "Can't create signalfd", errno);
+      return;
+    }
+
+  pid_t pid = fork ();
+  if (pid == -1)
+    {
+      send_error (conn, fds, "Can't fork", errno);
+      return;
+    }
+  if (pid == 0)
+    {
+      sigprocmask (SIG_UNBLOCK, &mask, NULL);
+      exec_command (cwd, env, argv, fds);
+    }
+
+  for (int i = 0; i < 3; i++)
+    close (fds[i]);
+
+  int status = 0;
+  for (;;)
+    {
+      struct pollfd pfds[2] = {
+        { .fd = conn, .events = POLLIN },
+        { .fd = sfd, .events = POLLIN },
+      };
+
+      if (poll (pfds, 2, -1) == -1)
+        {
+          if (errno == EINTR)
+            continue;
+          break;
+        }
+
+      if (pfds[1].revents & POLLIN)
+        {
+          struct signalfd_siginfo info;
+          if (read (sfd, &info, sizeof (info)) == -1 &&
+              errno != EINTR && errno != EAGAIN)
+            {
+              /* We can't tell when it exits any more; just wait */
+              waitpid (pid, &status, 0);
+              break;
+            }
+          if (waitpid (pid, &status, WNOHANG) == pid)
+            break;
+        }
+
+      if (pfds[0].revents & (POLLIN | POLLHUP | POLLERR))
+        {
+          unsigned char signum;
+          ssize_t n = read (conn, &signum, 1);
+          if (n == 1)
+            {
+              kill (-pid, signum);
+            }
+          else if (n == 0 || (n == -1 && errno != EINTR))
+            {
+              /* Client went away; like a terminal hangup */
+              kill (-pid, SIGHUP);
+              waitpid (pid, &status, 0);
+              return;
+            }
+        }
+    }
+
+  send_status (conn, status);
+}
+
+int
+main (int argc, char **argv)
+{
+  if (argc != 2)
+    {
+      fprintf (stderr, "Usage: pegg-exec-server SOCKET_PATH\n");
+      return 1;
+    }
+
+  socket_path = argv[1];
+
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  if (strlen (socket_path) >= sizeof (addr.sun_path))
+    {
+      fprintf (stderr, "pegg-exec-server: Socket path too long: %s\n", socket_path);
+      return 1;
+    }
+  strcpy (addr.sun_path, socket_path);
+
+  int listen_fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listen_fd == -1)
+    {
+      fprintf (stderr, "pegg-exec-server: Can't create socket: %s\n", strerror (errno));
+      return 1;
+    }
+
+  unlink (socket_path);
+  mode_t old_umask = umask (0077);
+  if (bind (listen_fd, (struct sockaddr *)&addr, sizeof (addr)) == -1)
+    {
+      fprintf (stderr, "pegg-exec-server: Can't bind to %s: %s\n", socket_path, strerror (errno));
+      return 1;
+    }
+  umask (old_umask);
+
+  if (listen (listen_fd, 16) == -1)
+    {
+      fprintf (stderr, "pegg-exec-server: Can't listen on %s: %s\n", socket_path, strerror (errno));
+      return 1;
+    }
+
+  /* We're normally PID 1 of the container; children that exit, including
+   * orphaned grandchildren, are reaped automatically */
+  signal (SIGCHLD, SIG_IGN);
+  signal (SIGPIPE, SIG_IGN);
+  signal (SIGTERM, on_terminate);
+  signal (SIGINT, on_terminate);
+
+  for (;;)
+    {
+      int conn = accept4 (listen_fd, NULL, NULL, SOCK_CLOEXEC);
+      if (conn == -1)
+        {
+          if (errno == EINTR || errno == ECONNABORTED)
+            continue;
+          fprintf (stderr, "pegg-exec-server: Error accepting connection: %s\n", strerror (errno));
+          return 1;
+        }
+
+      pid_t pid = fork ();
+      if (pid == 0)
+        {
+          close (listen_fd);
+          signal (SIGCHLD, SIG_DFL);
+          signal (SIGTERM, SIG_DFL);
+          signal (SIGINT, SIG_DFL);
+          handle_connection (conn);
+          _exit (0);
+        }
+
+      close (conn);
+    }
+}
@@ -3,6 +3,7 @@
 
 #include <stdlib.h>
 #include <termios.h>
+#include <unistd.h>
 
 #include <glib-unix.h>
 #include <gio/gio.h>
@@ -47,7 +48,8 @@ on_child_exited (GDBusConnection *connection,
 gboolean
 pegg_in_flatpak (void)
 {
-  int in_flatpak = -1;
+  /* This can't change while we're running */
+  static int in_flatpak = -1;
   if (in_flatpak == -1)
     {
       g_autofree char *flatpak_info = g_build_filename (g_get_user_runtime_dir (),
@@ -126,12 +128,73 @@ add_pty_fd (GUnixFDList *fd_list,
   return TRUE;
 }
 
-static void
-close_pipes(int *pipes)
+/* Adds one of our standard FD's to the list to be passed to the host
+ * command. Pipes and files are passed straight through, so output is
+ * byte-exact and doesn't get copied through this process; a terminal is
+ * forwarded through an intermediate pipe instead, because older versions
+ * of flatpak try to set ownership of the terminal when passed one, which
+ * produces a warning message.
+ *
+ * (See https://github.com/flatpak/flatpak/pull/512)
+ */
+static gboolean
+add_std_fd (GUnixFDList  *fd_list,
+            int           std_fd,
+            int          *handle,
+            GCancellable *cancellable,
+            GError      **error)
 {
-  for (int i = 0; i < 6; i++)
-    if (pipes[i] != -1)
-      (void) close(pipes[i]);
+  if (!isatty (std_fd))
+    {
+      *handle = g_unix_fd_list_append (fd_list, std_fd, error);
+      return *handle != -1;
+    }
+
+  int pipe_fds[2];
+  if (pipe (pipe_fds) == -1)
+    {
+      int errsv = errno;
+
+      g_set_error (error, G_IO_ERROR,
+                   g_io_error_from_errno (errsv),
+                   "Error opening pipe for channel: %s",
+                   g_strerror (errsv));
+      return FALSE;
+    }
+
+  /* The host command gets the read end for stdin, the write end otherwise;
+   * we keep the other end and close ours of the end we pass */
+  int remote_fd = std_fd == 0 ? pipe_fds[0] : pipe_fds[1];
+  int local_fd = std_fd == 0 ? pipe_fds[1] : pipe_fds[0];
+
+  *handle = g_unix_fd_list_append (fd_list, remote_fd, error);
+  (void) close (remote_fd);
+  if (*handle == -1)
+    {
+      (void) close (local_fd);
+      return FALSE;
+    }
+
+  if (std_fd == 0)
+    {
+      g_autoptr(GInputStream) in = g_unix_input_stream_new (std_fd, FALSE);
+      g_autoptr(GOutputStream) out = g_unix_output_stream_new (local_fd, TRUE);
+      g_output_stream_splice_async (out, in,
+                                    G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+                                    G_PRIORITY_DEFAULT, cancellable,
+                                    on_eof, NULL);
+    }
+  else
+    {
+      g_autoptr(GInputStream) in = g_unix_input_stream_new (local_fd, TRUE);
+      g_autoptr(GOutputStream) out = g_unix_output_stream_new (std_fd, FALSE);
+      g_output_stream_splice_async (out, in,
+                                    G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE,
+                                    G_PRIORITY_DEFAULT, cancellable,
+                                    on_eof, NULL);
+    }
+
+  return TRUE;
 }
 
 static GUnixFDList *
@@ -215,97 +278,25 @@ prepare_fd_list (PeggHostCommandFlags flags,
     }
   else
     {
-      fd_list = g_unix_fd_list_new ();
-
-      /* In the case where we are using a PTY, we need to forward input
-       * to the PTY. In the other case, we could normally just forward
-       * the stdin/stdout/stderr FD's directly to the host command; but
-       * this will produce a warning message with older versions flatpak,
-       * which try to set ownership of the terminal in all cases; to work
-       * around this, we use an intermediate pipe.
-       *
-       * (See https://github.com/flatpak/flatpak/pull/512)
-       */
-#if 0
-      *stdin_handle = g_unix_fd_list_append (fd_list, 0, error);
-      if (*stdin_handle == -1)
-        goto cleanup;
-      *stdout_handle = g_unix_fd_list_append (fd_list,
-                                              (flags & PEGG_HOST_COMMAND_STDOUT_TO_DEV_NULL) ? stdout_fd : 1,
-                                              error);
-      if (*stdout_handle == -1)
-        goto cleanup;
-      stdout_fd = -1;
-      *stderr_handle = g_unix_fd_list_append (fd_list, 2, error);
-      if (*stderr_handle == -1)
+      if (!add_std_fd (fd_list, 0, stdin_handle, cancellable, error))
         goto cleanup;
-#else
-      int pipes[6] = { -1, -1,  -1, -1,  -1, -1 };
-
-      if (pipe(pipes) == -1 ||
-          (!(flags & PEGG_HOST_COMMAND_STDOUT_TO_DEV_NULL) && pipe(pipes + 2) == -1) ||
-          pipe(pipes + 4) == -1)
-        {
-          int errsv = errno;
 
-          g_set_error (error, G_IO_ERROR,
-                       g_io_error_from_errno (errsv),
-                       "Error opening pipes for channels: %s",
-                       g_strerror (errsv));
-          close_pipes (pipes);
-          goto cleanup;
-        }
-
-      *stdin_handle = g_unix_fd_list_append (fd_list, pipes[0], error);
-      if (*stdin_handle == -1)
-        {
-          close_pipes (pipes);
-          goto cleanup;
-        }
-      *stdout_handle = g_unix_fd_list_append (fd_list,
-                                              (flags & PEGG_HOST_COMMAND_STDOUT_TO_DEV_NULL) ? stdout_fd : pipes[3],
-                                              error);
-      if (*stdout_handle == -1)
-        {
-          close_pipes (pipes);
-          goto cleanup;
-        }
-      stdout_fd = -1;
-      *stderr_handle = g_unix_fd_list_append (fd_list, pipes[5], error);
-      if (*stderr_handle == -1)
-        {
-          close_pipes (pipes);
-          goto cleanup;
-        }
-
-      g_autoptr(GInputStream) stdin = g_unix_input_stream_new(0, FALSE);
-      g_autoptr(GOutputStream) instream = g_unix_output_stream_new(pipes[1], FALSE);
-      g_output_stream_splice_async(instream, stdin,
-                                   G_OUTPUT_STREAM_SPLICE_NONE,
-                                   G_PRIORITY_DEFAULT, cancellable,
-                                   on_eof, NULL);
-
-      if (!(flags & PEGG_HOST_COMMAND_STDOUT_TO_DEV_NULL))
+      if (flags & PEGG_HOST_COMMAND_STDOUT_TO_DEV_NULL)
         {
-          g_autoptr(GOutputStream) stdout = g_unix_output_stream_new(1, FALSE);
-          g_autoptr(GInputStream) outstream = g_unix_input_stream_new(pipes[2], FALSE);
-          g_output_stream_splice_async(stdout, outstream,
-                                       G_OUTPUT_STREAM_SPLICE_NONE,
-                                       G_PRIORITY_DEFAULT, cancellable,
-                                       on_eof, NULL);
+          *stdout_handle = g_unix_fd_list_append (fd_list, stdout_fd, error);
+          if (*stdout_handle == -1)
+            goto cleanup;
         }
+      else if (!add_std_fd (fd_list, 1, stdout_handle, cancellable, error))
+        goto cleanup;
 
-      g_autoptr(GOutputStream) stderr = g_unix_output_stream_new(2, FALSE);
-      g_autoptr(GInputStream) errstream = g_unix_input_stream_new(pipes[4], FALSE);
-      g_output_stream_splice_async(stderr, errstream,
-                                   G_OUTPUT_STREAM_SPLICE_NONE,
-                                   G_PRIORITY_DEFAULT, cancellable,
-                                   on_eof, NULL);
-
-
-#endif
+      if (!add_std_fd (fd_list, 2, stderr_handle, cancellable, error))
+        goto cleanup;
     }
 
+  if (stdout_fd != -1)
+    close (stdout_fd);
+
   return g_object_ref (fd_list);
 
  cleanup:
@@ -326,7 +317,7 @@ pegg_call_host_command (GDBusConnection          *connection,
 {
   int stdin_handle, stdout_handle, stderr_handle;
   g_autoptr(GUnixFDList) fd_list = prepare_fd_list (flags,
-                                                    &stdin_handle, &stdin_handle, &stderr_handle,
+                                                    &stdin_handle, &stdout_handle, &stderr_handle,
                                                     cancellable, error);
   if (!fd_list)
     return -1;
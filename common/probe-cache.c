@@ -0,0 +1,266 @@
+#include <string.h>
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include "host-command.h"
+#include "probe-cache.h"
+
+typedef struct {
+  char *value;
+  gint64 expiry; /* seconds since the epoch */
+} ProbeCacheEntry;
+
+static GMutex cache_lock;
+static GHashTable *cache;
+
+/* Prefixes whose files are still being removed by invalidate_thread();
+ * lookups don't trust files with these keys in the meantime */
+static GPtrArray *pending_prefixes;
+
+static void
+probe_cache_entry_free (ProbeCacheEntry *entry)
+{
+  g_free (entry->value);
+  g_free (entry);
+}
+
+static gint64
+get_now (void)
+{
+  return g_get_real_time () / G_USEC_PER_SEC;
+}
+
+static const char *
+get_cache_dir (void)
+{
+  static char *cache_dir;
+
+  if (g_once_init_enter (&cache_dir))
+    {
+      char *dir = NULL;
+
+      /* Inside flatpak, $XDG_RUNTIME_DIR is private to this instance of
+       * the sandbox, but $XDG_RUNTIME_DIR/app/<app_id> is bind-mounted
+       * from the host, so it is shared with other instances (pegg run
+       * with 'flatpak run --command=pegg'). It is also the host's
+       * directory of the same path *if* the host uses /run/user/<uid>,
+       * the same hacky assumption as docker-launch makes; the host-side
+       * pegg doesn't look there anyway. Without the directory, we keep
+       * a cache of our own.
+       */
+      if (pegg_in_flatpak ())
+        {
+          g_autofree char *app_dir = g_build_filename (g_get_user_runtime_dir (),
+                                                       "app", "org.gnome.PurpleEgg",
+                                                       NULL);
+          if (g_file_test (app_dir, G_FILE_TEST_IS_DIR))
+            dir = g_build_filename (app_dir, "pegg-probes", NULL);
+        }
+
+      if (dir == NULL)
+        dir = g_build_filename (g_get_user_runtime_dir (), "pegg", "probes", NULL);
+
+      g_once_init_leave (&cache_dir, dir);
+    }
+
+  return cache_dir;
+}
+
+static char *
+get_cache_file (const char *key)
+{
+  g_autofree char *name = g_compute_checksum_for_string (G_CHECKSUM_SHA256, key, -1);
+  return g_build_filename (get_cache_dir (), name, NULL);
+}
+
+/* Splits the contents of a cache file; returns FALSE if it's malformed */
+static gboolean
+parse_cache_file (char        *contents,
+                  gint64      *expiry,
+                  const char **key,
+                  const char **value)
+{
+  char *end;
+  *expiry = g_ascii_strtoll (contents, &end, 10);
+  if (end == contents || *end != '\n')
+    return FALSE;
+
+  *key = end + 1;
+  char *newline = strchr (*key, '\n');
+  if (newline == NULL)
+    return FALSE;
+
+  *newline = '\0';
+  *value = newline + 1;
+
+  return TRUE;
+}
+
+static void
+ensure_cache (void)
+{
+  if (cache == NULL)
+    cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                   g_free, (GDestroyNotify)probe_cache_entry_free);
+  if (pending_prefixes == NULL)
+    pending_prefixes = g_ptr_array_new ();
+}
+
+static gboolean
+is_pending (const char *key)
+{
+  for (guint i = 0; i < pending_prefixes->len; i++)
+    if (g_str_has_prefix (key, pending_prefixes->pdata[i]))
+      return TRUE;
+
+  return FALSE;
+}
+
+/**
+ * pegg_probe_cache_lookup:
+ * @key: a key, conventionally of the form <kind>:<argument>
+ *
+ * Returns: (transfer full): the stored value, or %NULL if there is none
+ *   or it has expired
+ */
+char *
+pegg_probe_cache_lookup (const char *key)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&cache_lock);
+  gint64 now = get_now ();
+
+  ensure_cache ();
+
+  ProbeCacheEntry *entry = g_hash_table_lookup (cache, key);
+  if (entry != NULL && entry->expiry > now)
+    return g_strdup (entry->value);
+
+  if (is_pending (key))
+    return NULL;
+
+  /* Maybe another process has stored it */
+  g_autofree char *path = get_cache_file (key);
+  g_autofree char *contents = NULL;
+  if (!g_file_get_contents (path, &contents, NULL, NULL))
+    return NULL;
+
+  gint64 expiry;
+  const char *file_key;
+  const char *value;
+  if (!parse_cache_file (contents, &expiry, &file_key, &value) ||
+      strcmp (file_key, key) != 0 || expiry <= now)
+    return NULL;
+
+  entry = g_new0 (ProbeCacheEntry, 1);
+  entry->value = g_strdup (value);
+  entry->expiry = expiry;
+  g_hash_table_replace (cache, g_strdup (key), entry);
+
+  return g_strdup (value);
+}
+
+void
+pegg_probe_cache_store (const char *key,
+                        const char *value,
+                        int         ttl_seconds)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&cache_lock);
+  gint64 expiry = get_now () + ttl_seconds;
+
+  ensure_cache ();
+
+  ProbeCacheEntry *entry = g_new0 (ProbeCacheEntry, 1);
+  entry->value = g_strdup (value);
+  entry->expiry = expiry;
+  g_hash_table_replace (cache, g_strdup (key), entry);
+
+  if (g_mkdir_with_parents (get_cache_dir (), 0700) != 0)
+    return;
+
+  /* Written to a temporary file and renamed, so readers never see a
+   * partial entry */
+  g_autofree char *path = get_cache_file (key);
+  g_autofree char *contents = g_strdup_printf ("%" G_GINT64_FORMAT "\n%s\n%s",
+                                               expiry, key, value);
+  GError *error = NULL;
+  if (!g_file_set_contents (path, contents, -1, &error))
+    {
+      g_warning ("Can't write %s: %s", path, error->message);
+      g_clear_error (&error);
+    }
+}
+
+static void
+invalidate_thread (GTask        *task,
+                   gpointer      source_object,
+                   gpointer      task_data,
+                   GCancellable *cancellable)
+{
+  const char *prefix = task_data;
+  g_autoptr(GDir) dir = g_dir_open (get_cache_dir (), 0, NULL);
+
+  if (dir != NULL)
+    {
+      const char *name;
+      while ((name = g_dir_read_name (dir)) != NULL)
+        {
+          /* Skip temporary files from g_file_set_contents() */
+          if (strlen (name) != 64)
+            continue;
+
+          g_autofree char *path = g_build_filename (get_cache_dir (), name, NULL);
+          g_autofree char *contents = NULL;
+          gint64 expiry;
+          const char *file_key;
+          const char *value;
+
+          if (!g_file_get_contents (path, &contents, NULL, NULL))
+            continue;
+
+          /* Expired entries are removed along the way. A matching entry
+           * stored since pegg_probe_cache_invalidate() was called may be
+           * removed too, which just means probing again. */
+          if (!parse_cache_file (contents, &expiry, &file_key, &value) ||
+              expiry <= get_now () ||
+              g_str_has_prefix (file_key, prefix))
+            (void) g_unlink (path);
+        }
+    }
+
+  g_mutex_lock (&cache_lock);
+  g_ptr_array_remove (pending_prefixes, (gpointer)prefix);
+  g_mutex_unlock (&cache_lock);
+}
+
+/**
+ * pegg_probe_cache_invalidate:
+ * @prefix: prefix of the keys to remove
+ *
+ * Removes entries whose key starts with @prefix, from memory and for
+ * other processes. Call this after doing something that changes the
+ * result of a probe. The files of other processes are removed in a
+ * thread, since that means reading every file in the cache; until that
+ * is done, lookups of the keys here don't look at the files.
+ */
+void
+pegg_probe_cache_invalidate (const char *prefix)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&cache_lock);
+  GHashTableIter iter;
+  const char *key;
+
+  ensure_cache ();
+
+  g_hash_table_iter_init (&iter, cache);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&key, NULL))
+    if (g_str_has_prefix (key, prefix))
+      g_hash_table_iter_remove (&iter);
+
+  char *pending = g_strdup (prefix);
+  g_ptr_array_add (pending_prefixes, pending);
+
+  g_autoptr(GTask) task = g_task_new (NULL, NULL, NULL, NULL);
+  g_task_set_task_data (task, pending, g_free);
+  g_task_run_in_thread (task, invalidate_thread);
+}
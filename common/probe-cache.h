@@ -0,0 +1,26 @@
+
+#include <glib.h>
+
+#ifndef PROBE_CACHE_H
+#define PROBE_CACHE_H
+
+/* Memoizes the results of probing the host (docker images, git state, ...)
+ * for a short time. Entries are kept in memory, and also in files under
+ * $XDG_RUNTIME_DIR/pegg/probes (inside flatpak, preferably
+ * $XDG_RUNTIME_DIR/app/org.gnome.PurpleEgg/pegg-probes), so they are
+ * shared with other processes, including the pegg command line tool,
+ * which uses the same format:
+ *
+ *   <expiry time, in seconds since the epoch>\n<key>\n<value>
+ *
+ * in a file named after the hex SHA-256 of the key. Keys can't contain
+ * newlines.
+ */
+
+char *pegg_probe_cache_lookup     (const char *key);
+void  pegg_probe_cache_store      (const char *key,
+                                   const char *value,
+                                   int         ttl_seconds);
+void  pegg_probe_cache_invalidate (const char *prefix);
+
+#endif /* PROBE_CACHE_H */
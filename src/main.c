@@ -1,8 +1,11 @@
 #include "project-window.h"
+#include "startup-timeline.h"
 
 int
 main(int argc, char **argv)
 {
+  startup_timeline_mark ("main");
+
   gtk_init (&argc, &argv);
 
   ProjectApplication *app = project_application_new();
@@ -1,7 +1,11 @@
 #include <string.h>
 
 #include "project-application.h"
+#include "project-index.h"
+#include "project-matcher.h"
+#include "project-meta-cache.h"
 #include "project-window.h"
+#include "startup-timeline.h"
 #include "introspection.h"
 #include "search-generated.h"
 
@@ -10,6 +14,12 @@ struct _ProjectApplication
         GtkApplication parent_instance;
   guint registration_id;
   SearchProvider2 *search_skeleton;
+  ProjectIndex *index;
+  ProjectMetaCache *meta_cache;
+  ProjectFrecency *frecency;
+  gboolean start_resident;
+  gboolean resident;
+  ProjectTab *warm_tab;
 };
 
 G_DEFINE_TYPE (ProjectApplication, project_application, GTK_TYPE_APPLICATION)
@@ -34,7 +44,11 @@ project_application_new (void)
 static void
 project_application_finalize (GObject *object)
 {
-        // ProjectApplication *self = (ProjectApplication *)object;
+        ProjectApplication *self = (ProjectApplication *)object;
+
+        g_clear_object (&self->index);
+        g_clear_object (&self->meta_cache);
+        g_clear_object (&self->frecency);
 
         G_OBJECT_CLASS (project_application_parent_class)->finalize (object);
 }
@@ -69,104 +83,215 @@ project_application_set_property (GObject      *object,
           }
 }
 
-static GFile *
-get_project_directory (ProjectApplication *application)
+#define DEFAULT_MAX_DEPTH 3
+
+static char *
+expand_root (const char *root)
 {
-  g_autoptr(GFile) homedir = g_file_new_for_path (g_get_home_dir ());
-  return g_file_get_child (homedir, "Projects");
+  if (root[0] == '~' && (root[1] == '/' || root[1] == '\0'))
+    return g_build_filename (g_get_home_dir (), root + 1, NULL);
+
+  return g_strdup (root);
 }
 
-char **
-project_application_get_all_projects (ProjectApplication *self,
-                                      GError            **error)
+/* Reads the project roots from ~/.config/PurpleEgg/config:
+ *
+ *   [Projects]
+ *   Roots=~/Projects;~/src
+ *   Depth=3
+ *
+ * The pegg command line tool reads the same file; see read_projects_config()
+ * in cli/pegg.in.
+ */
+static void
+get_project_roots (char ***roots,
+                   int    *max_depth)
 {
-  GPtrArray *results = g_ptr_array_new();
+  g_autoptr(GKeyFile) keyfile = g_key_file_new ();
+  g_autofree char *config_file = g_build_filename (g_get_user_config_dir (), "PurpleEgg", "config", NULL);
+  GError *error = NULL;
 
-  g_autoptr(GFile) projects_file = get_project_directory (self);
+  *roots = NULL;
+  *max_depth = DEFAULT_MAX_DEPTH;
 
-  g_autoptr(GFileEnumerator) enumerator = g_file_enumerate_children (projects_file,
-                                                                     "standard::name",
-                                                                     G_FILE_QUERY_INFO_NONE,
-                                                                     NULL, error);
-  while (TRUE)
+  if (g_key_file_load_from_file (keyfile, config_file, G_KEY_FILE_NONE, &error))
     {
-      g_autoptr(GFileInfo) info = g_file_enumerator_next_file (enumerator, NULL, error);
-      if (info == NULL)
+      g_auto(GStrv) configured = g_key_file_get_string_list (keyfile, "Projects", "Roots", NULL, NULL);
+      if (configured != NULL && configured[0] != NULL)
         {
-          if (*error)
-            goto fail;
-          break;
+          GPtrArray *expanded = g_ptr_array_new ();
+          for (char **root = configured; *root; root++)
+            g_ptr_array_add (expanded, expand_root (*root));
+          g_ptr_array_add (expanded, NULL);
+          *roots = (char **)g_ptr_array_free (expanded, FALSE);
         }
 
-      const char *name = g_file_info_get_name (info);
-      g_autoptr(GFile) child = g_file_get_child (projects_file, name);
-      g_ptr_array_add (results, g_file_get_path(child));
+      if (g_key_file_has_key (keyfile, "Projects", "Depth", NULL))
+        *max_depth = CLAMP (g_key_file_get_integer (keyfile, "Projects", "Depth", NULL), 1, 16);
+    }
+  else
+    {
+      if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        g_warning ("Can't read %s: %s", config_file, error->message);
+      g_clear_error (&error);
     }
 
-  g_ptr_array_add (results, NULL);
-  return (char **)g_ptr_array_free (results, FALSE);
+  if (*roots == NULL)
+    {
+      *roots = g_new0 (char *, 2);
+      (*roots)[0] = g_build_filename (g_get_home_dir (), "Projects", NULL);
+    }
+}
+
+ProjectIndex *
+project_application_get_index (ProjectApplication *self)
+{
+  if (self->index == NULL)
+    {
+      g_auto(GStrv) roots = NULL;
+      int max_depth;
+
+      get_project_roots (&roots, &max_depth);
+      self->index = project_index_new ((const char *const *)roots, max_depth);
+    }
 
- fail:
-  g_ptr_array_free (results, TRUE);
-  return NULL;
+  return self->index;
 }
 
-static char **
-get_matching_projects (ProjectApplication *self,
-                       const char *const  *terms,
-                       GError            **error)
+ProjectFrecency *
+project_application_get_frecency (ProjectApplication *self)
 {
-  GPtrArray *results = g_ptr_array_new();
+  return self->frecency;
+}
 
-  g_autoptr(GFile) projects_file = get_project_directory (self);
+char **
+project_application_get_all_projects (ProjectApplication *self,
+                                      GError            **error)
+{
+  g_autoptr(GPtrArray) entries = project_index_get_entries (project_application_get_index (self));
+  GPtrArray *results = g_ptr_array_new();
 
-  g_autoptr(GFileEnumerator) enumerator = g_file_enumerate_children (projects_file,
-                                                                     "standard::name",
-                                                                     G_FILE_QUERY_INFO_NONE,
-                                                                     NULL, error);
-  g_auto(GStrv) folded_terms = g_new (char *, g_strv_length ((char **)terms));
-  int i = 0;
-  for (i = 0; terms[i]; i++)
+  for (guint i = 0; i < entries->len; i++)
     {
-      folded_terms[i] = g_utf8_casefold(terms[i], -1);
+      ProjectIndexEntry *entry = entries->pdata[i];
+      g_ptr_array_add (results, g_strdup (entry->path));
     }
-  folded_terms[i] = NULL;
 
-  while (TRUE)
-    {
-      g_autoptr(GFileInfo) info = g_file_enumerator_next_file (enumerator, NULL, error);
-      if (info == NULL)
-        {
-          if (*error)
-            goto fail;
-          break;
-        }
+  g_ptr_array_add (results, NULL);
+  return (char **)g_ptr_array_free (results, FALSE);
+}
 
-      const char *name = g_file_info_get_name (info);
-      g_autofree char *folded_name = g_utf8_casefold (name, -1);
-      gboolean matches = TRUE;
-      for (char **term = folded_terms; matches && *term; term++)
-        {
-          if (strstr(folded_name, *term) == NULL)
-            matches = FALSE;
-        }
+typedef struct {
+  ProjectIndexEntry *entry;
+  int score;
+} ProjectMatch;
 
-      if (matches)
-        {
-          g_autoptr(GFile) child = g_file_get_child (projects_file, name);
-          g_ptr_array_add (results, g_file_get_path(child));
-        }
+static int
+compare_matches (const void *a,
+                 const void *b)
+{
+  const ProjectMatch *match_a = a;
+  const ProjectMatch *match_b = b;
+
+  if (match_a->score != match_b->score)
+    return match_a->score < match_b->score ? 1 : -1;
+
+  return strcmp (match_a->entry->folded_name, match_b->entry->folded_name);
+}
+
+static void
+add_match (GArray            *matches,
+           ProjectMatcher    *matcher,
+           ProjectIndexEntry *entry)
+{
+  int score = project_matcher_score (matcher, entry->folded_name, entry->folded_name_len);
+  if (score >= 0)
+    {
+      ProjectMatch match = { entry, score };
+      g_array_append_val (matches, match);
     }
+}
 
-  if (!g_file_enumerator_close (enumerator, NULL, error))
-    goto fail;
+/* Returns the paths of the matches, best first */
+static char **
+matches_to_paths (GArray *matches)
+{
+  char **paths = g_new (char *, matches->len + 1);
 
-  g_ptr_array_add (results, NULL);
-  return (char **)g_ptr_array_free (results, FALSE);
+  g_array_sort (matches, compare_matches);
+  for (guint i = 0; i < matches->len; i++)
+    paths[i] = g_strdup (g_array_index (matches, ProjectMatch, i).entry->path);
+  paths[matches->len] = NULL;
+
+  return paths;
+}
 
-fail:
-  g_ptr_array_free (results, TRUE);
-  return NULL;
+typedef struct {
+  GPtrArray *candidates; /* ProjectIndexEntry */
+  char **terms;
+} SearchData;
+
+static void
+search_data_free (SearchData *data)
+{
+  g_ptr_array_unref (data->candidates);
+  g_strfreev (data->terms);
+  g_free (data);
+}
+
+/* Index entries are immutable, so they can be matched in a worker while
+ * the index changes on the main thread */
+static void
+search_thread (GTask        *task,
+               gpointer      source_object,
+               gpointer      task_data,
+               GCancellable *cancellable)
+{
+  SearchData *data = task_data;
+  g_autoptr(ProjectMatcher) matcher = project_matcher_new ((const char *const *)data->terms);
+  g_autoptr(GArray) matches = g_array_new (FALSE, FALSE, sizeof (ProjectMatch));
+
+  for (guint i = 0; i < data->candidates->len; i++)
+    add_match (matches, matcher, data->candidates->pdata[i]);
+
+  g_task_return_pointer (task, matches_to_paths (matches), (GDestroyNotify)g_strfreev);
+}
+
+static void
+search_projects_async (ProjectApplication  *self,
+                       GPtrArray           *candidates,
+                       const char *const   *terms,
+                       GAsyncReadyCallback  callback,
+                       gpointer             user_data)
+{
+  g_autoptr(GTask) task = g_task_new (self, NULL, callback, user_data);
+  SearchData *data = g_new0 (SearchData, 1);
+
+  data->candidates = g_ptr_array_ref (candidates);
+  data->terms = g_strdupv ((char **)terms);
+  g_task_set_task_data (task, data, (GDestroyNotify)search_data_free);
+  g_task_run_in_thread (task, search_thread);
+}
+
+static char **
+search_projects_finish (ProjectApplication *self,
+                        GAsyncResult       *result)
+{
+  return g_task_propagate_pointer (G_TASK (result), NULL);
+}
+
+static void
+on_initial_result_set_ready (GObject      *source_object,
+                             GAsyncResult *result,
+                             gpointer      user_data)
+{
+  ProjectApplication *self = PROJECT_APPLICATION (source_object);
+  g_autoptr(GDBusMethodInvocation) invocation = user_data;
+  g_auto(GStrv) results = search_projects_finish (self, result);
+
+  search_provider2_complete_get_initial_result_set (self->search_skeleton,
+                                                    invocation,
+                                                    (const char *const *)results);
 }
 
 static gboolean
@@ -175,21 +300,31 @@ handle_get_initial_result_set (SearchProvider2       *object,
                                const gchar *const    *arg_terms,
                                ProjectApplication    *self)
 {
-  GError *error = NULL;
-  g_auto(GStrv) results = get_matching_projects (self, arg_terms, &error);
-  if (!results)
-    {
-      g_dbus_method_invocation_take_error (invocation, error);
-      return TRUE;
-    }
+  g_autoptr(GPtrArray) entries = project_index_get_entries (project_application_get_index (self));
 
-  search_provider2_complete_get_initial_result_set (object,
-                                                    invocation,
-                                                    (const char *const *)results);
+  search_projects_async (self, entries, arg_terms,
+                         on_initial_result_set_ready, g_object_ref (invocation));
 
   return TRUE;
 }
 
+static void
+on_subsearch_result_set_ready (GObject      *source_object,
+                               GAsyncResult *result,
+                               gpointer      user_data)
+{
+  ProjectApplication *self = PROJECT_APPLICATION (source_object);
+  g_autoptr(GDBusMethodInvocation) invocation = user_data;
+  g_auto(GStrv) results = search_projects_finish (self, result);
+
+  search_provider2_complete_get_subsearch_result_set (self->search_skeleton,
+                                                      invocation,
+                                                      (const char *const *)results);
+}
+
+/* The terms of a subsearch only ever extend the previous terms, so the
+ * results are a subset of the previous results; matching only those keeps
+ * each keystroke proportional to the number of current matches */
 static gboolean
 handle_get_subsearch_result_set (SearchProvider2       *object,
                                  GDBusMethodInvocation *invocation,
@@ -197,43 +332,131 @@ handle_get_subsearch_result_set (SearchProvider2       *object,
                                  const gchar *const    *arg_terms,
                                  ProjectApplication    *self)
 {
-  GError *error = NULL;
-  g_auto(GStrv) results = get_matching_projects (self, arg_terms, &error);
-  if (!results)
+  ProjectIndex *index = project_application_get_index (self);
+  g_autoptr(GPtrArray) candidates = g_ptr_array_new_with_free_func ((GDestroyNotify)project_index_entry_unref);
+
+  for (const char *const *path = arg_previous_results; *path; path++)
     {
-      g_dbus_method_invocation_take_error (invocation, error);
-      return TRUE;
+      /* Projects removed since the previous search aren't in the index */
+      ProjectIndexEntry *entry = project_index_lookup (index, *path);
+      if (entry != NULL)
+        g_ptr_array_add (candidates, project_index_entry_ref (entry));
     }
-  search_provider2_complete_get_subsearch_result_set (object,
-                                                      invocation,
-                                                      (const char *const *)results);
+
+  search_projects_async (self, candidates, arg_terms,
+                         on_subsearch_result_set_ready, g_object_ref (invocation));
 
   return TRUE;
 }
 
+static void
+add_result_meta (GVariantBuilder   *builder,
+                 const char        *identifier,
+                 const ProjectMeta *meta)
+{
+  g_variant_builder_open (builder, G_VARIANT_TYPE ("a{sv}"));
+  g_variant_builder_add (builder, "{sv}", "id", g_variant_new ("s", identifier));
+
+  if (meta != NULL)
+    {
+      GString *description = g_string_new (identifier);
+      if (meta->git_branch)
+        g_string_append_printf (description, " \u2022 %s", meta->git_branch);
+      if (meta->has_container)
+        g_string_append (description, " \u2022 container");
+
+      g_autoptr(GDateTime) mtime = g_date_time_new_from_unix_local (meta->modified);
+      g_autofree char *modified = g_date_time_format (mtime, "%x");
+      g_string_append_printf (description, " \u2022 modified %s", modified);
+
+      g_variant_builder_add (builder, "{sv}", "name", g_variant_new ("s", meta->name));
+      g_variant_builder_add (builder, "{sv}", "description",
+                             g_variant_new_take_string (g_string_free (description, FALSE)));
+    }
+  else
+    {
+      g_autofree char *basename = g_path_get_basename (identifier);
+      g_variant_builder_add (builder, "{sv}", "name", g_variant_new ("s", basename));
+      g_variant_builder_add (builder, "{sv}", "description", g_variant_new ("s", identifier));
+    }
+
+  g_variant_builder_add (builder, "{sv}", "gicon", g_variant_new ("s", "folder"));
+  g_variant_builder_close (builder);
+}
+
+static void
+complete_result_metas (ProjectApplication    *self,
+                       GDBusMethodInvocation *invocation)
+{
+  GVariant *parameters = g_dbus_method_invocation_get_parameters (invocation);
+  g_autofree const char **identifiers = NULL;
+  GVariantBuilder builder;
+
+  g_variant_get (parameters, "(^a&s)", &identifiers);
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("aa{sv}"));
+  for (const char **identifier = identifiers; *identifier; identifier++)
+    add_result_meta (&builder, *identifier,
+                     project_meta_cache_lookup (self->meta_cache, *identifier));
+
+  search_provider2_complete_get_result_metas (self->search_skeleton,
+                                              invocation,
+                                              g_variant_builder_end (&builder));
+}
+
+static void
+on_metas_updated (GObject      *source_object,
+                  GAsyncResult *result,
+                  gpointer      user_data)
+{
+  ProjectMetaCache *meta_cache = PROJECT_META_CACHE (source_object);
+  g_autoptr(GDBusMethodInvocation) invocation = user_data;
+  GError *error = NULL;
+
+  if (!project_meta_cache_update_finish (meta_cache, result, &error))
+    {
+      g_warning ("Failed to compute result metas: %s", error->message);
+      g_clear_error (&error);
+    }
+
+  if (invocation != NULL)
+    {
+      ProjectApplication *self = g_object_get_data (G_OBJECT (invocation), "application");
+      complete_result_metas (self, invocation);
+    }
+}
+
+/* Metas are served from the cache; missing ones are computed before
+ * replying, while cached ones are revalidated after replying */
 static gboolean
 handle_get_result_metas (SearchProvider2       *object,
                          GDBusMethodInvocation *invocation,
                          const gchar *const    *arg_identifiers,
                          ProjectApplication    *self)
 {
-  GVariantBuilder builder;
-  g_variant_builder_init (&builder, G_VARIANT_TYPE ("aa{sv}"));
+  gboolean all_cached = TRUE;
 
   for (const char *const *identifier = arg_identifiers; *identifier; identifier++)
     {
-      g_variant_builder_open (&builder, G_VARIANT_TYPE ("a{sv}"));
-      g_variant_builder_add (&builder, "{sv}", "id", g_variant_new ("s", *identifier));
-      g_autofree char *basename = g_path_get_basename (*identifier);
-      g_variant_builder_add (&builder, "{sv}", "name", g_variant_new ("s", basename));
-      g_variant_builder_add (&builder, "{sv}", "description", g_variant_new ("s", *identifier));
-      g_variant_builder_add (&builder, "{sv}", "gicon", g_variant_new ("s", "folder"));
-      g_variant_builder_close (&builder);
+      if (project_meta_cache_lookup (self->meta_cache, *identifier) == NULL)
+        {
+          all_cached = FALSE;
+          break;
+        }
     }
 
-  search_provider2_complete_get_result_metas (object,
-                                              invocation,
-                                              g_variant_builder_end (&builder));
+  if (all_cached)
+    {
+      complete_result_metas (self, invocation);
+      project_meta_cache_update_async (self->meta_cache, arg_identifiers,
+                                       on_metas_updated, NULL);
+    }
+  else
+    {
+      g_object_set_data_full (G_OBJECT (invocation), "application",
+                              g_object_ref (self), g_object_unref);
+      project_meta_cache_update_async (self->meta_cache, arg_identifiers,
+                                       on_metas_updated, g_object_ref (invocation));
+    }
 
   return TRUE;
 }
@@ -337,11 +560,113 @@ create_or_activate_window (ProjectApplication *self,
   gtk_window_present_with_time (GTK_WINDOW (window), timestamp);
 }
 
+/* In resident mode (--resident), the application keeps running without
+ * windows, with a tab where the login shell and pegg shell are already
+ * running, so that the next project window only has to start the
+ * environment for the project */
+static void prepare_warm_tab (ProjectApplication *self);
+
+static void
+on_warm_tab_destroy (ProjectTab         *tab,
+                     ProjectApplication *self)
+{
+  g_signal_handlers_disconnect_by_func (tab, on_warm_tab_destroy, self);
+  g_clear_object (&self->warm_tab);
+}
+
+static gboolean
+prepare_warm_tab_idle (gpointer user_data)
+{
+  prepare_warm_tab (user_data);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+prepare_warm_tab (ProjectApplication *self)
+{
+  if (!self->resident || self->warm_tab != NULL)
+    return;
+
+  self->warm_tab = g_object_ref_sink (project_tab_new (NULL));
+  g_signal_connect (self->warm_tab, "destroy",
+                    G_CALLBACK (on_warm_tab_destroy), self);
+}
+
+/* Returns the warm tab, started in directory, or NULL; the caller owns
+ * the returned reference */
+ProjectTab *
+project_application_take_warm_tab (ProjectApplication *self,
+                                   const char         *directory)
+{
+  ProjectTab *tab = self->warm_tab;
+
+  /* Until it's ready, it's no faster than a new tab */
+  if (tab != NULL && !project_tab_get_ready (tab))
+    return NULL;
+
+  self->warm_tab = NULL;
+  if (self->resident)
+    {
+      /* Prepare the next one once the window is up */
+      g_idle_add_full (G_PRIORITY_LOW, prepare_warm_tab_idle,
+                       g_object_ref (self), g_object_unref);
+    }
+
+  if (tab == NULL)
+    return NULL;
+
+  g_signal_handlers_disconnect_by_func (tab, on_warm_tab_destroy, self);
+  project_tab_adopt (tab, directory);
+
+  return tab;
+}
+
+static gint
+project_application_handle_local_options (GApplication *application,
+                                          GVariantDict *options)
+{
+  ProjectApplication *self = PROJECT_APPLICATION (application);
+  GError *error = NULL;
+
+  if (g_variant_dict_contains (options, "startup-timeline"))
+    startup_timeline_enable ();
+
+  if (g_variant_dict_contains (options, "resident"))
+    {
+      if (!g_application_register (application, NULL, &error))
+        {
+          g_printerr ("%s\n", error->message);
+          g_clear_error (&error);
+          return 1;
+        }
+
+      /* Already running */
+      if (g_application_get_is_remote (application))
+        return 0;
+
+      self->start_resident = TRUE;
+    }
+
+  return -1;
+}
+
 static void
 project_application_activate (GApplication *application)
 {
   ProjectApplication *self = PROJECT_APPLICATION (application);
 
+  startup_timeline_mark ("activate");
+
+  if (self->start_resident)
+    {
+      self->start_resident = FALSE;
+      self->resident = TRUE;
+      g_application_hold (application);
+      prepare_warm_tab (self);
+      return;
+    }
+
   GList *l = gtk_application_get_windows (GTK_APPLICATION (self));
   if (l && l->data)
     gtk_window_present (l->data);
@@ -352,6 +677,22 @@ project_application_activate (GApplication *application)
     }
 }
 
+static void
+project_application_shutdown (GApplication *application)
+{
+  ProjectApplication *self = PROJECT_APPLICATION (application);
+
+  project_frecency_flush (self->frecency);
+
+  if (self->warm_tab)
+    {
+      g_autoptr(ProjectTab) tab = g_object_ref (self->warm_tab);
+      gtk_widget_destroy (GTK_WIDGET (tab));
+    }
+
+  G_APPLICATION_CLASS (project_application_parent_class)->shutdown (application);
+}
+
 static void
 project_application_class_init (ProjectApplicationClass *klass)
 {
@@ -362,7 +703,9 @@ project_application_class_init (ProjectApplicationClass *klass)
   object_class->get_property = project_application_get_property;
   object_class->set_property = project_application_set_property;
 
+  application_class->handle_local_options = project_application_handle_local_options;
   application_class->activate = project_application_activate;
+  application_class->shutdown = project_application_shutdown;
   application_class->dbus_register = project_application_dbus_register;
   application_class->dbus_unregister = project_application_dbus_unregister;
 }
@@ -386,6 +729,18 @@ static const char *decrease_font_size_accels[] = { "<Control>minus", NULL };
 static void
 project_application_init (ProjectApplication *self)
 {
+  g_application_add_main_option (G_APPLICATION (self), "resident", 0,
+                                 G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE,
+                                 "Keep running in the background, with a terminal ready for the next project",
+                                 NULL);
+  g_application_add_main_option (G_APPLICATION (self), "startup-timeline", 0,
+                                 G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE,
+                                 "Print how long each step of starting up takes",
+                                 NULL);
+
+  self->meta_cache = project_meta_cache_new ();
+  self->frecency = project_frecency_new ();
+
   gtk_application_set_accels_for_action (GTK_APPLICATION (self),
                                          "win.set_active_tab(1)",
                                          tab1_accels);
@@ -3,6 +3,10 @@
 
 #include <gtk/gtk.h>
 
+#include "project-frecency.h"
+#include "project-index.h"
+#include "project-tab.h"
+
 G_BEGIN_DECLS
 
 #define PROJECT_TYPE_APPLICATION (project_application_get_type())
@@ -12,6 +16,11 @@ G_DECLARE_FINAL_TYPE (ProjectApplication, project_application, PROJECT, APPLICAT
 ProjectApplication *project_application_new (void);
 
 
+ProjectIndex    *project_application_get_index    (ProjectApplication *application);
+ProjectFrecency *project_application_get_frecency (ProjectApplication *application);
+ProjectTab      *project_application_take_warm_tab (ProjectApplication *application,
+                                                    const char         *directory);
+
 char **project_application_get_all_projects (ProjectApplication *application,
                                              GError            **error);
 G_END_DECLS
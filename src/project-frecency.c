@@ -0,0 +1,350 @@
+#include <errno.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "project-frecency.h"
+
+/* Records how often and how recently projects are opened, so the greeter
+ * can show the projects that are likely to be wanted first. The visits
+ * are kept in ~/.local/share/PurpleEgg/frecency, one line per project:
+ *
+ *   PEGGFRC1\n<visits> <last visit, in seconds since the epoch> <path>\n...
+ *
+ * The file is read through a mapping at startup. Recorded visits are
+ * written out a few seconds later, together with any other visits made
+ * in the meantime, from a worker thread, so that opening a project never
+ * waits for the disk. The worker also drops projects that no longer
+ * exist; it runs once after startup for that, too.
+ */
+#define FRECENCY_MAGIC "PEGGFRC1\n"
+#define SAVE_DELAY_SECONDS 5
+
+typedef struct {
+  guint visits;
+  gint64 last_visit;
+} Visits;
+
+struct _ProjectFrecency
+{
+  GObject parent_instance;
+  char *file;
+  GMutex mutex;       /* Protects the fields up to written; scores are read
+                       * from worker threads */
+  GHashTable *visits; /* path => Visits */
+  gboolean dirty;     /* visits has changes that aren't in the file */
+  gboolean writing;   /* save_thread() is running */
+  GCond written;      /* Signalled when save_thread() is done */
+  guint save_id;
+  gboolean saving;
+  gboolean save_again;
+};
+
+G_DEFINE_TYPE (ProjectFrecency, project_frecency, G_TYPE_OBJECT)
+
+ProjectFrecency *
+project_frecency_new (void)
+{
+  return g_object_new (PROJECT_TYPE_FRECENCY, NULL);
+}
+
+static void
+load (ProjectFrecency *self)
+{
+  g_autoptr(GMappedFile) file = g_mapped_file_new (self->file, FALSE, NULL);
+  if (file == NULL)
+    return;
+
+  const char *p = g_mapped_file_get_contents (file);
+  const char *end = p + g_mapped_file_get_length (file);
+  gsize magic_len = strlen (FRECENCY_MAGIC);
+
+  if ((gsize)(end - p) < magic_len || memcmp (p, FRECENCY_MAGIC, magic_len) != 0)
+    return;
+
+  p += magic_len;
+  while (p < end)
+    {
+      const char *newline = memchr (p, '\n', end - p);
+      if (newline == NULL)
+        break;
+
+      /* The mapping isn't nul-terminated */
+      g_autofree char *line = g_strndup (p, newline - p);
+      p = newline + 1;
+
+      char *field = line;
+      guint64 visits = g_ascii_strtoull (field, &field, 10);
+      if (*field != ' ')
+        continue;
+      gint64 last_visit = g_ascii_strtoll (field + 1, &field, 10);
+      if (*field != ' ' || field[1] == '\0')
+        continue;
+
+      Visits *v = g_new0 (Visits, 1);
+      v->visits = visits;
+      v->last_visit = last_visit;
+      g_hash_table_replace (self->visits, g_strdup (field + 1), v);
+    }
+}
+
+/* Drops the visits of projects that have been deleted. This stats every
+ * project, so it's only done from save_thread(). */
+static void
+prune (ProjectFrecency *self)
+{
+  g_autoptr(GPtrArray) paths = g_ptr_array_new_with_free_func (g_free);
+  GHashTableIter iter;
+  const char *path;
+
+  g_mutex_lock (&self->mutex);
+  g_hash_table_iter_init (&iter, self->visits);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&path, NULL))
+    g_ptr_array_add (paths, g_strdup (path));
+  g_mutex_unlock (&self->mutex);
+
+  /* Not holding the lock while checking, which can take a while */
+  g_autoptr(GPtrArray) gone = g_ptr_array_new ();
+  for (guint i = 0; i < paths->len; i++)
+    if (!g_file_test (paths->pdata[i], G_FILE_TEST_EXISTS))
+      g_ptr_array_add (gone, paths->pdata[i]);
+
+  g_mutex_lock (&self->mutex);
+  for (guint i = 0; i < gone->len; i++)
+    if (g_hash_table_remove (self->visits, gone->pdata[i]))
+      self->dirty = TRUE;
+  g_mutex_unlock (&self->mutex);
+}
+
+/* Returns the contents of the file, or NULL if it's up-to-date */
+static GString *
+serialize (ProjectFrecency *self)
+{
+  GString *contents = NULL;
+  GHashTableIter iter;
+  const char *path;
+  Visits *v;
+
+  g_mutex_lock (&self->mutex);
+  if (self->dirty)
+    {
+      contents = g_string_new (FRECENCY_MAGIC);
+      g_hash_table_iter_init (&iter, self->visits);
+      while (g_hash_table_iter_next (&iter, (gpointer *)&path, (gpointer *)&v))
+        g_string_append_printf (contents, "%u %" G_GINT64_FORMAT " %s\n", v->visits, v->last_visit, path);
+      self->dirty = FALSE;
+    }
+  g_mutex_unlock (&self->mutex);
+
+  return contents;
+}
+
+static void
+write_file (const char *file,
+            GString    *contents)
+{
+  GError *error = NULL;
+  g_autofree char *dir = g_path_get_dirname (file);
+
+  if (g_mkdir_with_parents (dir, 0755) != 0)
+    {
+      g_warning ("Can't create %s: %s", dir, g_strerror (errno));
+      return;
+    }
+
+  if (!g_file_set_contents (file, contents->str, contents->len, &error))
+    {
+      g_warning ("Can't save project visits: %s", error->message);
+      g_clear_error (&error);
+    }
+}
+
+static void
+save_thread (GTask        *task,
+             gpointer      source_object,
+             gpointer      task_data,
+             GCancellable *cancellable)
+{
+  ProjectFrecency *self = source_object;
+
+  prune (self);
+
+  GString *contents = serialize (self);
+  if (contents != NULL)
+    {
+      write_file (self->file, contents);
+      g_string_free (contents, TRUE);
+    }
+
+  g_mutex_lock (&self->mutex);
+  self->writing = FALSE;
+  g_cond_broadcast (&self->written);
+  g_mutex_unlock (&self->mutex);
+
+  g_task_return_boolean (task, TRUE);
+}
+
+static gboolean save_timeout (gpointer user_data);
+
+static void
+on_saved (GObject      *source_object,
+          GAsyncResult *result,
+          gpointer      user_data)
+{
+  ProjectFrecency *self = PROJECT_FRECENCY (source_object);
+
+  self->saving = FALSE;
+  if (self->save_again)
+    {
+      self->save_again = FALSE;
+      if (self->save_id == 0)
+        save_timeout (self);
+    }
+}
+
+static gboolean
+save_timeout (gpointer user_data)
+{
+  ProjectFrecency *self = user_data;
+
+  self->save_id = 0;
+
+  /* Don't let two writes of the file race */
+  if (self->saving)
+    {
+      self->save_again = TRUE;
+      return G_SOURCE_REMOVE;
+    }
+
+  self->saving = TRUE;
+
+  g_mutex_lock (&self->mutex);
+  self->writing = TRUE;
+  g_mutex_unlock (&self->mutex);
+
+  g_autoptr(GTask) task = g_task_new (self, NULL, on_saved, NULL);
+  g_task_run_in_thread (task, save_thread);
+
+  return G_SOURCE_REMOVE;
+}
+
+void
+project_frecency_record (ProjectFrecency *self,
+                         const char      *path)
+{
+  if (strchr (path, '\n') != NULL)
+    return;
+
+  g_mutex_lock (&self->mutex);
+  Visits *v = g_hash_table_lookup (self->visits, path);
+  if (v == NULL)
+    {
+      v = g_new0 (Visits, 1);
+      g_hash_table_insert (self->visits, g_strdup (path), v);
+    }
+  v->visits++;
+  v->last_visit = g_get_real_time () / G_USEC_PER_SEC;
+  self->dirty = TRUE;
+  g_mutex_unlock (&self->mutex);
+
+  if (self->save_id == 0)
+    self->save_id = g_timeout_add_seconds (SAVE_DELAY_SECONDS, save_timeout, self);
+}
+
+/* The number of visits, weighted by how recent the last one was; 0 for
+ * projects that have never been opened. now is in seconds since the
+ * epoch. Can be called from any thread. */
+double
+project_frecency_get_score (ProjectFrecency *self,
+                            const char      *path,
+                            gint64           now)
+{
+  double score = 0;
+
+  g_mutex_lock (&self->mutex);
+  Visits *v = g_hash_table_lookup (self->visits, path);
+  if (v != NULL)
+    {
+      gint64 age_days = (now - v->last_visit) / (24 * 60 * 60);
+      double weight;
+
+      if (age_days < 4)
+        weight = 100;
+      else if (age_days < 14)
+        weight = 70;
+      else if (age_days < 31)
+        weight = 50;
+      else if (age_days < 90)
+        weight = 30;
+      else
+        weight = 10;
+
+      score = v->visits * weight;
+    }
+  g_mutex_unlock (&self->mutex);
+
+  return score;
+}
+
+/* Writes out pending visits immediately; for use when exiting */
+void
+project_frecency_flush (ProjectFrecency *self)
+{
+  if (self->save_id)
+    {
+      g_source_remove (self->save_id);
+      self->save_id = 0;
+    }
+  self->save_again = FALSE;
+
+  /* A save that is already running would otherwise overwrite what we
+   * write with older visits */
+  g_mutex_lock (&self->mutex);
+  while (self->writing)
+    g_cond_wait (&self->written, &self->mutex);
+  g_mutex_unlock (&self->mutex);
+
+  GString *contents = serialize (self);
+  if (contents != NULL)
+    {
+      write_file (self->file, contents);
+      g_string_free (contents, TRUE);
+    }
+}
+
+static void
+project_frecency_finalize (GObject *object)
+{
+  ProjectFrecency *self = PROJECT_FRECENCY (object);
+
+  project_frecency_flush (self);
+
+  g_clear_pointer (&self->visits, g_hash_table_destroy);
+  g_cond_clear (&self->written);
+  g_mutex_clear (&self->mutex);
+  g_free (self->file);
+
+  G_OBJECT_CLASS (project_frecency_parent_class)->finalize (object);
+}
+
+static void
+project_frecency_class_init (ProjectFrecencyClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = project_frecency_finalize;
+}
+
+static void
+project_frecency_init (ProjectFrecency *self)
+{
+  g_mutex_init (&self->mutex);
+  g_cond_init (&self->written);
+  self->visits = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  self->file = g_build_filename (g_get_user_data_dir (), "PurpleEgg", "frecency", NULL);
+
+  load (self);
+
+  /* To prune deleted projects; nothing is written if there are none */
+  if (g_hash_table_size (self->visits) > 0)
+    self->save_id = g_timeout_add_seconds (SAVE_DELAY_SECONDS, save_timeout, self);
+}
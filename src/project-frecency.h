@@ -0,0 +1,22 @@
+#ifndef PROJECT_FRECENCY_H
+#define PROJECT_FRECENCY_H
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define PROJECT_TYPE_FRECENCY (project_frecency_get_type())
+
+G_DECLARE_FINAL_TYPE (ProjectFrecency, project_frecency, PROJECT, FRECENCY, GObject)
+
+ProjectFrecency *project_frecency_new       (void);
+void             project_frecency_record    (ProjectFrecency *frecency,
+                                             const char      *path);
+double           project_frecency_get_score (ProjectFrecency *frecency,
+                                             const char      *path,
+                                             gint64           now);
+void             project_frecency_flush     (ProjectFrecency *frecency);
+
+G_END_DECLS
+
+#endif /* PROJECT_FRECENCY_H */
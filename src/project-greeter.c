@@ -1,16 +1,87 @@
 #include <string.h>
-#include <stdlib.h>
 
 #include "host-command.h"
 #include "project-tab.h"
 #include "project-greeter.h"
+#include "project-matcher.h"
+
+/* The projects are shown from a GListStore bound to the list box. The
+ * items are created, and their collation keys and frecency scores
+ * computed, in a worker thread, and rows are created as items are added
+ * to the store. Only the first rows are added, more when the list is
+ * scrolled near its end, so the greeter appears immediately however
+ * many projects there are. When the search or the index changes, only
+ * the range of the store that differs is replaced, so the other rows
+ * and the scroll position are kept.
+ */
+#define FIRST_CHUNK_SIZE 50
+#define CHUNK_SIZE 50
+
+#define PROJECT_TYPE_GREETER_ITEM (project_greeter_item_get_type())
+
+G_DECLARE_FINAL_TYPE (ProjectGreeterItem, project_greeter_item, PROJECT, GREETER_ITEM, GObject)
+
+struct _ProjectGreeterItem
+{
+  GObject parent_instance;
+  ProjectIndexEntry *entry;
+  char *collate_key;
+  double frecency;
+  int score; /* For the current search */
+};
+
+G_DEFINE_TYPE (ProjectGreeterItem, project_greeter_item, G_TYPE_OBJECT)
+
+static void
+project_greeter_item_finalize (GObject *object)
+{
+  ProjectGreeterItem *self = PROJECT_GREETER_ITEM (object);
+
+  g_clear_pointer (&self->entry, project_index_entry_unref);
+  g_free (self->collate_key);
+
+  G_OBJECT_CLASS (project_greeter_item_parent_class)->finalize (object);
+}
+
+static void
+project_greeter_item_class_init (ProjectGreeterItemClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = project_greeter_item_finalize;
+}
+
+static void
+project_greeter_item_init (ProjectGreeterItem *self)
+{
+}
+
+static ProjectGreeterItem *
+project_greeter_item_new (ProjectIndexEntry *entry)
+{
+  ProjectGreeterItem *item = g_object_new (PROJECT_TYPE_GREETER_ITEM, NULL);
+  item->entry = project_index_entry_ref (entry);
+  item->collate_key = g_utf8_collate_key (entry->name, -1);
+
+  return item;
+}
 
 struct _ProjectGreeter
 {
   GtkBin parent_instance;
   ProjectWindow *window;
   GtkWidget *titlebar;
+  GtkScrolledWindow *scrolled_window;
   GtkListBox *listbox;
+  GtkSearchEntry *search_entry;
+  ProjectIndex *index;
+  GCancellable *load_cancellable;
+  GPtrArray *items;        /* ProjectGreeterItem, most used first; NULL until loaded */
+  GPtrArray *shown;        /* Items matching the search, in display order */
+  GListStore *model;       /* The first n_wanted of shown */
+  guint n_wanted;          /* How many rows to create */
+  guint add_rows_id;
+  ProjectMatcher *matcher; /* NULL when not searching */
 };
 
 G_DEFINE_TYPE (ProjectGreeter, project_greeter, GTK_TYPE_BIN)
@@ -37,6 +108,15 @@ project_greeter_new (ProjectWindow *window)
 static void
 project_greeter_finalize (GObject *object)
 {
+  ProjectGreeter *self = PROJECT_GREETER (object);
+
+  g_clear_object (&self->index);
+  g_clear_object (&self->load_cancellable);
+  g_clear_pointer (&self->items, g_ptr_array_unref);
+  g_clear_pointer (&self->shown, g_ptr_array_unref);
+  g_clear_object (&self->model);
+  g_clear_pointer (&self->matcher, project_matcher_free);
+
   G_OBJECT_CLASS (project_greeter_parent_class)->finalize (object);
 }
 
@@ -76,64 +156,341 @@ project_greeter_set_property (GObject      *object,
   }
 }
 
+/* Projects that are opened often and recently first, then by name */
 static int
-compare_project_names (const void *a, const void *b)
+compare_items_by_frecency (gconstpointer a,
+                           gconstpointer b)
 {
-  const char *name_a = *(char **)a;
-  const char *name_b = *(char **)b;
+  const ProjectGreeterItem *item_a = *(ProjectGreeterItem **)a;
+  const ProjectGreeterItem *item_b = *(ProjectGreeterItem **)b;
 
-  return g_utf8_collate (name_a, name_b);
+  if (item_a->frecency != item_b->frecency)
+    return item_a->frecency < item_b->frecency ? 1 : -1;
+
+  return strcmp (item_a->collate_key, item_b->collate_key);
 }
 
+static int
+compare_items_by_score (gconstpointer a,
+                        gconstpointer b)
+{
+  const ProjectGreeterItem *item_a = *(ProjectGreeterItem **)a;
+  const ProjectGreeterItem *item_b = *(ProjectGreeterItem **)b;
+
+  if (item_a->score != item_b->score)
+    return item_a->score < item_b->score ? 1 : -1;
+
+  return compare_items_by_frecency (a, b);
+}
+
+/* Whether the items show the same project, when they may come from
+ * different loads of the index */
+static gboolean
+same_item (ProjectGreeterItem *a,
+           ProjectGreeterItem *b)
+{
+  return a == b || (strcmp (a->entry->path, b->entry->path) == 0 &&
+                    strcmp (a->entry->name, b->entry->name) == 0);
+}
+
+/* Makes the store hold the first n_wanted of shown, replacing only the
+ * range that changed */
 static void
-on_row_activated (GtkListBox     *listbox,
-                  GtkListBoxRow  *row,
-                  ProjectGreeter *self)
+update_model (ProjectGreeter *self)
 {
-  GtkWidget *label = gtk_bin_get_child (GTK_BIN (row));
-  g_autofree char *directory = g_strdup (g_object_get_data (G_OBJECT (label), "project-directory"));
-  project_window_set_directory (self->window, directory);
+  GListModel *model = G_LIST_MODEL (self->model);
+  guint n_old = g_list_model_get_n_items (model);
+  guint n_new = MIN (self->n_wanted, self->shown->len);
+  guint prefix = 0;
+  guint suffix = 0;
+
+  while (prefix < n_old && prefix < n_new)
+    {
+      g_autoptr(ProjectGreeterItem) item = g_list_model_get_item (model, prefix);
+      if (!same_item (item, self->shown->pdata[prefix]))
+        break;
+      prefix++;
+    }
+
+  while (suffix < n_old - prefix && suffix < n_new - prefix)
+    {
+      g_autoptr(ProjectGreeterItem) item = g_list_model_get_item (model, n_old - suffix - 1);
+      if (!same_item (item, self->shown->pdata[n_new - suffix - 1]))
+        break;
+      suffix++;
+    }
+
+  if (prefix + suffix == n_old && prefix + suffix == n_new)
+    return;
+
+  g_list_store_splice (self->model, prefix, n_old - prefix - suffix,
+                       self->shown->pdata + prefix, n_new - prefix - suffix);
+}
+
+/* Adds more rows when the end of the list is less than a page away */
+static gboolean
+add_rows_idle (gpointer user_data)
+{
+  ProjectGreeter *self = user_data;
+  GtkAdjustment *adjustment = gtk_scrolled_window_get_vadjustment (self->scrolled_window);
+  double page_size = gtk_adjustment_get_page_size (adjustment);
+  double end = gtk_adjustment_get_value (adjustment) + page_size;
+
+  self->add_rows_id = 0;
+
+  /* Not allocated yet; we get here again when it is */
+  if (page_size == 0)
+    return G_SOURCE_REMOVE;
+
+  if (self->shown != NULL && self->n_wanted < self->shown->len &&
+      end >= gtk_adjustment_get_upper (adjustment) - page_size)
+    {
+      self->n_wanted += CHUNK_SIZE;
+      update_model (self);
+    }
+
+  return G_SOURCE_REMOVE;
 }
 
+/* Not adding rows right away, since this happens during size allocation */
 static void
-project_greeter_constructed (GObject *object)
+on_adjustment_changed (GtkAdjustment  *adjustment,
+                       ProjectGreeter *self)
 {
-  ProjectGreeter *self = PROJECT_GREETER (object);
-  ProjectApplication *application = PROJECT_APPLICATION (gtk_window_get_application (GTK_WINDOW (self->window)));
+  if (self->add_rows_id == 0)
+    self->add_rows_id = g_idle_add (add_rows_idle, self);
+}
 
-  add_window_actions (self);
+static void
+show_items (ProjectGreeter *self)
+{
+  g_clear_pointer (&self->shown, g_ptr_array_unref);
+  self->shown = g_ptr_array_new_with_free_func (g_object_unref);
+
+  for (guint i = 0; self->items && i < self->items->len; i++)
+    {
+      ProjectGreeterItem *item = self->items->pdata[i];
+      if (self->matcher != NULL)
+        {
+          item->score = project_matcher_score (self->matcher,
+                                               item->entry->folded_name,
+                                               item->entry->folded_name_len);
+          if (item->score < 0)
+            continue;
+        }
+
+      g_ptr_array_add (self->shown, g_object_ref (item));
+    }
+
+  if (self->matcher != NULL)
+    g_ptr_array_sort (self->shown, compare_items_by_score);
+
+  update_model (self);
+
+  /* If the rows don't fill the view, scrolling won't ask for more */
+  on_adjustment_changed (gtk_scrolled_window_get_vadjustment (self->scrolled_window), self);
+}
 
+typedef struct {
+  GPtrArray *entries;
+  ProjectFrecency *frecency;
+} LoadData;
+
+static void
+load_data_free (LoadData *data)
+{
+  g_ptr_array_unref (data->entries);
+  g_object_unref (data->frecency);
+  g_free (data);
+}
+
+static void
+load_items_thread (GTask        *task,
+                   gpointer      source_object,
+                   gpointer      task_data,
+                   GCancellable *cancellable)
+{
+  LoadData *data = task_data;
+  GPtrArray *items = g_ptr_array_new_full (data->entries->len, g_object_unref);
+  gint64 now = g_get_real_time () / G_USEC_PER_SEC;
+
+  for (guint i = 0; i < data->entries->len; i++)
+    {
+      ProjectGreeterItem *item = project_greeter_item_new (data->entries->pdata[i]);
+      item->frecency = project_frecency_get_score (data->frecency, item->entry->path, now);
+      g_ptr_array_add (items, item);
+    }
+
+  g_ptr_array_sort (items, compare_items_by_frecency);
+
+  g_task_return_pointer (task, items, (GDestroyNotify)g_ptr_array_unref);
+}
+
+static void
+on_items_loaded (GObject      *source_object,
+                 GAsyncResult *result,
+                 gpointer      user_data)
+{
   GError *error = NULL;
-  g_auto(GStrv) projects = project_application_get_all_projects (application, &error);
-  if (projects == NULL)
+  GPtrArray *items = g_task_propagate_pointer (G_TASK (result), &error);
+
+  /* This only fails if the greeter was destroyed or the index changed */
+  if (items == NULL)
     {
-      g_warning ("Failed to load projects: %s", error->message);
       g_clear_error (&error);
-      goto out;
+      return;
     }
 
-  qsort(projects, g_strv_length (projects), sizeof(char *), compare_project_names);
+  ProjectGreeter *self = PROJECT_GREETER (source_object);
+  g_clear_pointer (&self->items, g_ptr_array_unref);
+  self->items = items;
+
+  show_items (self);
+}
+
+static void
+load_items (ProjectGreeter *self)
+{
+  ProjectApplication *application = PROJECT_APPLICATION (gtk_window_get_application (GTK_WINDOW (self->window)));
+  LoadData *data = g_new0 (LoadData, 1);
+
+  data->entries = project_index_get_entries (self->index);
+  data->frecency = g_object_ref (project_application_get_frecency (application));
+
+  if (self->load_cancellable)
+    g_cancellable_cancel (self->load_cancellable);
+  g_clear_object (&self->load_cancellable);
+  self->load_cancellable = g_cancellable_new ();
+
+  g_autoptr(GTask) task = g_task_new (self, self->load_cancellable, on_items_loaded, NULL);
+  g_task_set_task_data (task, data, (GDestroyNotify)load_data_free);
+  g_task_run_in_thread (task, load_items_thread);
+}
+
+static void
+on_index_changed (ProjectIndex   *index,
+                  ProjectGreeter *self)
+{
+  load_items (self);
+}
+
+static GtkWidget *
+create_row (gpointer item,
+            gpointer user_data)
+{
+  ProjectGreeterItem *greeter_item = item;
+  GtkWidget *label = gtk_label_new (greeter_item->entry->name);
+  gtk_widget_show (label);
+
+  return label;
+}
+
+static void
+open_item (ProjectGreeter *self,
+           guint           position)
+{
+  g_autoptr(ProjectGreeterItem) item = g_list_model_get_item (G_LIST_MODEL (self->model), position);
+  if (item == NULL)
+    return;
+
+  /* Setting the directory destroys the greeter */
+  g_autofree char *directory = g_strdup (item->entry->path);
+  project_window_set_directory (self->window, directory);
+}
+
+static void
+on_search_changed (GtkSearchEntry *entry,
+                   ProjectGreeter *self)
+{
+  const char *text = gtk_entry_get_text (GTK_ENTRY (entry));
+  g_auto(GStrv) terms = g_strsplit_set (text, " \t", -1);
+  guint n_terms = 0;
 
-  for (char **dirp = projects; *dirp; dirp++)
+  /* Drop the empty strings between repeated separators */
+  for (guint i = 0; terms[i]; i++)
     {
-      const char *dir = *dirp;
-      g_autofree char *name = g_path_get_basename (dir);
-      GtkWidget *label = gtk_label_new (name);
-      g_object_set_data_full (G_OBJECT (label), "project-directory", g_strdup (dir), g_free);
-      gtk_widget_show (label);
-      gtk_container_add (GTK_CONTAINER (self->listbox), label);
+      if (*terms[i] != '\0')
+        terms[n_terms++] = terms[i];
+      else
+        g_free (terms[i]);
     }
+  terms[n_terms] = NULL;
+
+  g_clear_pointer (&self->matcher, project_matcher_free);
+  if (n_terms > 0)
+    self->matcher = project_matcher_new ((const char *const *)terms);
+
+  show_items (self);
+}
+
+/* Enter in the search entry opens the best match */
+static void
+on_search_activate (GtkSearchEntry *entry,
+                    ProjectGreeter *self)
+{
+  open_item (self, 0);
+}
+
+static void
+on_row_activated (GtkListBox     *listbox,
+                  GtkListBoxRow  *row,
+                  ProjectGreeter *self)
+{
+  open_item (self, gtk_list_box_row_get_index (row));
+}
+
+static void
+project_greeter_constructed (GObject *object)
+{
+  ProjectGreeter *self = PROJECT_GREETER (object);
+  ProjectApplication *application = PROJECT_APPLICATION (gtk_window_get_application (GTK_WINDOW (self->window)));
+
+  add_window_actions (self);
+
+  self->model = g_list_store_new (PROJECT_TYPE_GREETER_ITEM);
+  self->n_wanted = FIRST_CHUNK_SIZE;
+  gtk_list_box_bind_model (self->listbox, G_LIST_MODEL (self->model),
+                           create_row, self, NULL);
+
+  self->index = g_object_ref (project_application_get_index (application));
+  g_signal_connect (self->index, "changed",
+                    G_CALLBACK (on_index_changed), self);
+  load_items (self);
 
   g_signal_connect (self->listbox, "row-activated",
                     G_CALLBACK (on_row_activated), self);
+  g_signal_connect (self->search_entry, "search-changed",
+                    G_CALLBACK (on_search_changed), self);
+  g_signal_connect (self->search_entry, "activate",
+                    G_CALLBACK (on_search_activate), self);
+
+  GtkAdjustment *adjustment = gtk_scrolled_window_get_vadjustment (self->scrolled_window);
+  g_signal_connect_object (adjustment, "value-changed",
+                           G_CALLBACK (on_adjustment_changed), self, 0);
+  g_signal_connect_object (adjustment, "changed",
+                           G_CALLBACK (on_adjustment_changed), self, 0);
 
- out:
   G_OBJECT_CLASS (project_greeter_parent_class)->constructed (object);
 }
 
 static void
 project_greeter_destroy (GtkWidget *widget)
 {
+  ProjectGreeter *self = PROJECT_GREETER (widget);
+
+  if (self->index)
+    g_signal_handlers_disconnect_by_func (self->index, on_index_changed, self);
+  if (self->load_cancellable)
+    g_cancellable_cancel (self->load_cancellable);
+  if (self->scrolled_window)
+    g_signal_handlers_disconnect_by_func (gtk_scrolled_window_get_vadjustment (self->scrolled_window),
+                                          on_adjustment_changed, self);
+  if (self->add_rows_id)
+    {
+      g_source_remove (self->add_rows_id);
+      self->add_rows_id = 0;
+    }
+
   GTK_WIDGET_CLASS (project_greeter_parent_class)->destroy (widget);
 }
 
@@ -165,7 +522,9 @@ project_greeter_class_init (ProjectGreeterClass *klass)
   gtk_widget_class_set_template_from_resource (GTK_WIDGET_CLASS (klass),
                                                "/org/gnome/PurpleEgg/project-greeter.ui");
   gtk_widget_class_bind_template_child (GTK_WIDGET_CLASS (klass), ProjectGreeter, titlebar);
+  gtk_widget_class_bind_template_child (GTK_WIDGET_CLASS (klass), ProjectGreeter, scrolled_window);
   gtk_widget_class_bind_template_child (GTK_WIDGET_CLASS (klass), ProjectGreeter, listbox);
+  gtk_widget_class_bind_template_child (GTK_WIDGET_CLASS (klass), ProjectGreeter, search_entry);
 }
 
 static void
@@ -179,10 +538,7 @@ open_cb (GSimpleAction *action,
   if (!row)
     return;
 
-  GtkWidget *label = gtk_bin_get_child (GTK_BIN (row));
-  g_autofree char *directory = g_strdup (g_object_get_data (G_OBJECT (label), "project-directory"));
-
-  project_window_set_directory (self->window, directory);
+  open_item (self, gtk_list_box_row_get_index (row));
 }
 
 static void
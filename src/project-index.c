@@ -0,0 +1,1073 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+
+#include "project-index.h"
+
+/* An in-memory index of the projects under the project roots, so that
+ * searching doesn't need to touch the filesystem.
+ *
+ * A project is a directory containing pegg.yaml or .git, up to max-depth
+ * levels below a root; hidden directories and projects aren't searched
+ * for further projects. The roots are crawled in a thread pool, one
+ * directory per job.
+ *
+ * Every directory that could contain a project, or become one, is then
+ * monitored, and changes are applied as they happen: projects that are
+ * created, deleted or renamed are added or removed directly, and only
+ * new directories that aren't projects yet are crawled. Project
+ * directories themselves aren't monitored, so one that stops being a
+ * project without being removed stays in the index until the next start.
+ * For a root that doesn't exist, the nearest parent that does is
+ * monitored instead, and the root is crawled once it appears.
+ *
+ * The index is saved to ~/.cache/PurpleEgg when it changes, and loaded
+ * from there at startup, so that it's usable immediately:
+ *
+ *   PEGGIDX1\n<roots, separated by ;>;depth=<max depth>\n<path>\0<path>\0...
+ *
+ * The saved index is ignored if the roots or depth have changed.
+ */
+#define INDEX_MAGIC "PEGGIDX1\n"
+
+struct _ProjectIndex
+{
+  GObject parent_instance;
+  char **roots;
+  int max_depth;
+  char *signature;
+  char *cache_file;
+  GHashTable *watches;  /* path => Watch */
+  GHashTable *root_watches; /* root => RootWatch, for roots that don't exist */
+  GHashTable *pending;  /* path => depth, directories waiting to be crawled */
+  GPtrArray *crawling;  /* CrawlJob, where the running crawl started, or NULL */
+  gboolean saving;
+  gboolean save_again;
+  GHashTable *entries;  /* path => ProjectIndexEntry */
+  GPtrArray *snapshot;  /* Created on demand, cleared when entries change */
+};
+
+G_DEFINE_TYPE (ProjectIndex, project_index, G_TYPE_OBJECT)
+
+enum {
+  PROP_0,
+  PROP_ROOTS,
+  PROP_MAX_DEPTH,
+  N_PROPS
+};
+
+static GParamSpec *properties [N_PROPS];
+
+enum {
+  CHANGED,
+  N_SIGNALS
+};
+
+static guint signals [N_SIGNALS];
+
+static ProjectIndexEntry *
+project_index_entry_new (const char *path)
+{
+  ProjectIndexEntry *entry = g_new0 (ProjectIndexEntry, 1);
+  entry->ref_count = 1;
+  entry->path = g_strdup (path);
+  entry->name = g_path_get_basename (path);
+  entry->folded_name = g_utf8_casefold (entry->name, -1);
+  entry->folded_name_len = strlen (entry->folded_name);
+
+  return entry;
+}
+
+ProjectIndexEntry *
+project_index_entry_ref (ProjectIndexEntry *entry)
+{
+  g_atomic_int_inc (&entry->ref_count);
+  return entry;
+}
+
+void
+project_index_entry_unref (ProjectIndexEntry *entry)
+{
+  if (g_atomic_int_dec_and_test (&entry->ref_count))
+    {
+      g_free (entry->path);
+      g_free (entry->name);
+      g_free (entry->folded_name);
+      g_free (entry);
+    }
+}
+
+ProjectIndex *
+project_index_new (const char *const *roots,
+                   int                max_depth)
+{
+  return g_object_new (PROJECT_TYPE_INDEX,
+                       "roots", roots,
+                       "max-depth", max_depth,
+                       NULL);
+}
+
+static gboolean
+add_entry (ProjectIndex *self,
+           const char   *path)
+{
+  if (g_hash_table_contains (self->entries, path))
+    return FALSE;
+
+  ProjectIndexEntry *entry = project_index_entry_new (path);
+  g_hash_table_insert (self->entries, entry->path, entry);
+
+  return TRUE;
+}
+
+static gboolean
+load_saved_index (ProjectIndex *self)
+{
+  g_autoptr(GMappedFile) file = g_mapped_file_new (self->cache_file, FALSE, NULL);
+  if (file == NULL)
+    return FALSE;
+
+  const char *p = g_mapped_file_get_contents (file);
+  const char *end = p + g_mapped_file_get_length (file);
+  gsize magic_len = strlen (INDEX_MAGIC);
+  gsize signature_len = strlen (self->signature);
+
+  if (end - p < (gssize)(magic_len + signature_len + 1) ||
+      memcmp (p, INDEX_MAGIC, magic_len) != 0 ||
+      memcmp (p + magic_len, self->signature, signature_len) != 0 ||
+      p[magic_len + signature_len] != '\n')
+    return FALSE;
+
+  p += magic_len + signature_len + 1;
+  while (p < end)
+    {
+      const char *nul = memchr (p, '\0', end - p);
+      if (nul == NULL)
+        break;
+
+      add_entry (self, p);
+      p = nul + 1;
+    }
+
+  return TRUE;
+}
+
+typedef struct {
+  char *cache_file;
+  char *signature;
+  GPtrArray *paths;
+} SaveData;
+
+static void
+save_data_free (SaveData *data)
+{
+  g_free (data->cache_file);
+  g_free (data->signature);
+  g_ptr_array_unref (data->paths);
+  g_free (data);
+}
+
+static void
+save_thread (GTask        *task,
+             gpointer      source_object,
+             gpointer      task_data,
+             GCancellable *cancellable)
+{
+  SaveData *data = task_data;
+  GError *error = NULL;
+  g_autofree char *cache_dir = g_path_get_dirname (data->cache_file);
+  g_autoptr(GString) contents = g_string_new (INDEX_MAGIC);
+
+  g_string_append (contents, data->signature);
+  g_string_append_c (contents, '\n');
+  for (guint i = 0; i < data->paths->len; i++)
+    g_string_append_len (contents, data->paths->pdata[i], strlen (data->paths->pdata[i]) + 1);
+
+  if (g_mkdir_with_parents (cache_dir, 0755) != 0 ||
+      !g_file_set_contents (data->cache_file, contents->str, contents->len, &error))
+    {
+      g_warning ("Can't save project index to %s: %s", data->cache_file,
+                 error ? error->message : g_strerror (errno));
+      g_clear_error (&error);
+    }
+
+  g_task_return_boolean (task, TRUE);
+}
+
+static int
+compare_paths (gconstpointer a,
+               gconstpointer b)
+{
+  return strcmp (*(const char **)a, *(const char **)b);
+}
+
+static void save (ProjectIndex *self);
+
+static void
+on_saved (GObject      *source_object,
+          GAsyncResult *result,
+          gpointer      user_data)
+{
+  ProjectIndex *self = PROJECT_INDEX (source_object);
+
+  self->saving = FALSE;
+  if (self->save_again)
+    save (self);
+}
+
+static void
+save (ProjectIndex *self)
+{
+  /* Don't let two writes of the file race */
+  if (self->saving)
+    {
+      self->save_again = TRUE;
+      return;
+    }
+
+  self->saving = TRUE;
+  self->save_again = FALSE;
+
+  SaveData *data = g_new0 (SaveData, 1);
+  data->cache_file = g_strdup (self->cache_file);
+  data->signature = g_strdup (self->signature);
+  data->paths = g_ptr_array_new_full (g_hash_table_size (self->entries), g_free);
+
+  GHashTableIter iter;
+  const char *path;
+  g_hash_table_iter_init (&iter, self->entries);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&path, NULL))
+    g_ptr_array_add (data->paths, g_strdup (path));
+  g_ptr_array_sort (data->paths, compare_paths);
+
+  g_autoptr(GTask) task = g_task_new (self, NULL, on_saved, NULL);
+  g_task_set_task_data (task, data, (GDestroyNotify)save_data_free);
+  g_task_run_in_thread (task, save_thread);
+}
+
+static void
+entries_changed (ProjectIndex *self)
+{
+  g_clear_pointer (&self->snapshot, g_ptr_array_unref);
+  g_signal_emit (self, signals[CHANGED], 0);
+  save (self);
+}
+
+typedef struct {
+  char *path;
+  int depth;
+} CrawlJob;
+
+static CrawlJob *
+crawl_job_new (const char *path,
+               int         depth)
+{
+  CrawlJob *job = g_new0 (CrawlJob, 1);
+  job->path = g_strdup (path);
+  job->depth = depth;
+
+  return job;
+}
+
+static void
+crawl_job_free (gpointer data)
+{
+  CrawlJob *job = data;
+
+  g_free (job->path);
+  g_free (job);
+}
+
+typedef struct {
+  GThreadPool *pool;
+  int max_depth;
+  GMutex mutex;
+  GCond done;
+  int pending;            /* Jobs queued or running, protected by mutex */
+  GPtrArray *projects;    /* Paths, protected by mutex */
+  GPtrArray *directories; /* CrawlJob for each directory to monitor, protected by mutex */
+} Crawl;
+
+static void
+crawl_free (Crawl *crawl)
+{
+  g_ptr_array_unref (crawl->projects);
+  g_ptr_array_unref (crawl->directories);
+  g_free (crawl);
+}
+
+static void
+crawl_push (Crawl *crawl,
+            char  *path,
+            int    depth)
+{
+  CrawlJob *job = g_new0 (CrawlJob, 1);
+  job->path = path;
+  job->depth = depth;
+
+  g_mutex_lock (&crawl->mutex);
+  crawl->pending++;
+  g_mutex_unlock (&crawl->mutex);
+
+  g_thread_pool_push (crawl->pool, job, NULL);
+}
+
+static gboolean
+is_project (const char *path)
+{
+  g_autofree char *pegg_yaml = g_build_filename (path, "pegg.yaml", NULL);
+  g_autofree char *git = g_build_filename (path, ".git", NULL);
+
+  return g_file_test (pegg_yaml, G_FILE_TEST_EXISTS) || g_file_test (git, G_FILE_TEST_EXISTS);
+}
+
+/* Adds path, a directory depth levels below a root, to the projects if it
+ * is one, or crawls it otherwise; takes ownership of path */
+static void
+crawl_child (Crawl    *crawl,
+             char     *path,
+             int       depth,
+             gboolean  is_link)
+{
+  if (is_project (path))
+    {
+      g_mutex_lock (&crawl->mutex);
+      g_ptr_array_add (crawl->projects, path);
+      g_mutex_unlock (&crawl->mutex);
+    }
+  /* Symbolic links to projects are found, but not followed further,
+   * so there can't be loops */
+  else if (!is_link)
+    {
+      crawl_push (crawl, path, depth);
+    }
+  else
+    {
+      g_free (path);
+    }
+}
+
+static void
+crawl_directory (gpointer data,
+                 gpointer user_data)
+{
+  CrawlJob *job = data;
+  Crawl *crawl = user_data;
+  gboolean exists = TRUE;
+
+  /* Directories at the maximum depth can't contain projects, but are
+   * still monitored for becoming one */
+  if (job->depth < crawl->max_depth)
+    {
+      DIR *dir = opendir (job->path);
+      exists = dir != NULL;
+
+      struct dirent *dirent;
+      while (dir != NULL && (dirent = readdir (dir)) != NULL)
+        {
+          /* Also skips . and .. */
+          if (dirent->d_name[0] == '.')
+            continue;
+
+          /* Some filesystems don't fill in d_type; find it out without
+           * following symbolic links, so that they're never descended into */
+          unsigned char type = dirent->d_type;
+          if (type == DT_UNKNOWN)
+            {
+              struct stat st;
+              if (fstatat (dirfd (dir), dirent->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+                continue;
+              type = S_ISDIR (st.st_mode) ? DT_DIR : (S_ISLNK (st.st_mode) ? DT_LNK : DT_REG);
+            }
+
+          if (type != DT_DIR && type != DT_LNK)
+            continue;
+
+          char *child = g_build_filename (job->path, dirent->d_name, NULL);
+          if (type == DT_LNK && !g_file_test (child, G_FILE_TEST_IS_DIR))
+            {
+              g_free (child);
+              continue;
+            }
+
+          crawl_child (crawl, child, job->depth + 1, type == DT_LNK);
+        }
+
+      if (dir != NULL)
+        closedir (dir);
+    }
+
+  g_mutex_lock (&crawl->mutex);
+  if (exists)
+    g_ptr_array_add (crawl->directories, job);
+  else
+    crawl_job_free (job);
+  if (--crawl->pending == 0)
+    g_cond_signal (&crawl->done);
+  g_mutex_unlock (&crawl->mutex);
+}
+
+typedef struct {
+  GPtrArray *starts; /* CrawlJob */
+  int max_depth;
+} CrawlData;
+
+static void
+crawl_data_free (CrawlData *data)
+{
+  g_ptr_array_unref (data->starts);
+  g_free (data);
+}
+
+static void
+crawl_thread (GTask        *task,
+              gpointer      source_object,
+              gpointer      task_data,
+              GCancellable *cancellable)
+{
+  CrawlData *data = task_data;
+  Crawl *crawl = g_new0 (Crawl, 1);
+
+  g_mutex_init (&crawl->mutex);
+  g_cond_init (&crawl->done);
+  crawl->max_depth = data->max_depth;
+  crawl->projects = g_ptr_array_new_with_free_func (g_free);
+  crawl->directories = g_ptr_array_new_with_free_func (crawl_job_free);
+  crawl->pool = g_thread_pool_new (crawl_directory, crawl,
+                                   MAX (4, g_get_num_processors ()), FALSE, NULL);
+
+  /* Hold off the end of the crawl until all the starting points are in */
+  crawl->pending = 1;
+
+  for (guint i = 0; i < data->starts->len; i++)
+    {
+      CrawlJob *start = data->starts->pdata[i];
+      struct stat st;
+
+      /* Roots are always crawled; anything else is checked like the
+       * contents of the directory it's in */
+      if (start->depth == 0)
+        crawl_push (crawl, g_strdup (start->path), 0);
+      else if (lstat (start->path, &st) != 0)
+        continue;
+      else if (S_ISDIR (st.st_mode))
+        crawl_child (crawl, g_strdup (start->path), start->depth, FALSE);
+      else if (S_ISLNK (st.st_mode) && g_file_test (start->path, G_FILE_TEST_IS_DIR))
+        crawl_child (crawl, g_strdup (start->path), start->depth, TRUE);
+    }
+
+  g_mutex_lock (&crawl->mutex);
+  crawl->pending--;
+  while (crawl->pending > 0)
+    g_cond_wait (&crawl->done, &crawl->mutex);
+  g_mutex_unlock (&crawl->mutex);
+
+  g_thread_pool_free (crawl->pool, FALSE, TRUE);
+  g_mutex_clear (&crawl->mutex);
+  g_cond_clear (&crawl->done);
+
+  g_task_return_pointer (task, crawl, (GDestroyNotify)crawl_free);
+}
+
+/* Whether path is dir or something inside it */
+static gboolean
+is_under (const char *path,
+          const char *dir)
+{
+  gsize len = strlen (dir);
+
+  return strncmp (path, dir, len) == 0 && (path[len] == '\0' || path[len] == '/');
+}
+
+static gboolean
+is_under_any (const char *path,
+              GPtrArray  *dirs)
+{
+  for (guint i = 0; i < dirs->len; i++)
+    {
+      CrawlJob *dir = dirs->pdata[i];
+      if (is_under (path, dir->path))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+typedef struct {
+  ProjectIndex *index;
+  char *path;
+  int depth;
+  GFileMonitor *monitor;
+} Watch;
+
+static void on_directory_changed (GFileMonitor      *monitor,
+                                  GFile             *file,
+                                  GFile             *other_file,
+                                  GFileMonitorEvent  event_type,
+                                  Watch             *watch);
+
+static void
+watch_free (gpointer data)
+{
+  Watch *watch = data;
+
+  g_signal_handlers_disconnect_by_func (watch->monitor, on_directory_changed, watch);
+  g_file_monitor_cancel (watch->monitor);
+  g_object_unref (watch->monitor);
+  g_free (watch->path);
+  g_free (watch);
+}
+
+static void
+add_watch (ProjectIndex *self,
+           const char   *path,
+           int           depth)
+{
+  GError *error = NULL;
+
+  if (g_hash_table_contains (self->watches, path))
+    return;
+
+  g_autoptr(GFile) file = g_file_new_for_path (path);
+  GFileMonitor *monitor = g_file_monitor_directory (file, G_FILE_MONITOR_WATCH_MOVES,
+                                                    NULL, &error);
+  if (monitor == NULL)
+    {
+      g_warning ("Can't monitor %s: %s", path, error->message);
+      g_clear_error (&error);
+      return;
+    }
+
+  Watch *watch = g_new0 (Watch, 1);
+  watch->index = self;
+  watch->path = g_strdup (path);
+  watch->depth = depth;
+  watch->monitor = monitor;
+  g_signal_connect (monitor, "changed", G_CALLBACK (on_directory_changed), watch);
+  g_hash_table_insert (self->watches, watch->path, watch);
+}
+
+typedef struct {
+  ProjectIndex *index;
+  char *root;
+  GFileMonitor *monitor; /* On the nearest parent of root that exists */
+} RootWatch;
+
+static void on_root_parent_changed (GFileMonitor      *monitor,
+                                    GFile             *file,
+                                    GFile             *other_file,
+                                    GFileMonitorEvent  event_type,
+                                    RootWatch         *root_watch);
+
+static void
+root_watch_free (gpointer data)
+{
+  RootWatch *root_watch = data;
+
+  g_signal_handlers_disconnect_by_func (root_watch->monitor, on_root_parent_changed, root_watch);
+  g_file_monitor_cancel (root_watch->monitor);
+  g_object_unref (root_watch->monitor);
+  g_free (root_watch->root);
+  g_free (root_watch);
+}
+
+static void queue_crawl (ProjectIndex *self,
+                         const char   *path,
+                         int           depth);
+
+/* Crawls root if it exists by now, or waits for it to be created */
+static void
+watch_root (ProjectIndex *self,
+            const char   *root)
+{
+  GError *error = NULL;
+
+  g_hash_table_remove (self->root_watches, root);
+
+  if (g_file_test (root, G_FILE_TEST_IS_DIR))
+    {
+      queue_crawl (self, root, 0);
+      return;
+    }
+
+  g_autofree char *parent = g_path_get_dirname (root);
+  while (!g_file_test (parent, G_FILE_TEST_IS_DIR))
+    {
+      char *grandparent = g_path_get_dirname (parent);
+      gboolean at_top = strcmp (grandparent, parent) == 0;
+      g_free (parent);
+      parent = grandparent;
+      if (at_top)
+        return;
+    }
+
+  g_autoptr(GFile) file = g_file_new_for_path (parent);
+  GFileMonitor *monitor = g_file_monitor_directory (file, G_FILE_MONITOR_WATCH_MOVES,
+                                                    NULL, &error);
+  if (monitor == NULL)
+    {
+      g_warning ("Can't monitor %s: %s", parent, error->message);
+      g_clear_error (&error);
+      return;
+    }
+
+  RootWatch *root_watch = g_new0 (RootWatch, 1);
+  root_watch->index = self;
+  root_watch->root = g_strdup (root);
+  root_watch->monitor = monitor;
+  g_signal_connect (monitor, "changed", G_CALLBACK (on_root_parent_changed), root_watch);
+  g_hash_table_insert (self->root_watches, root_watch->root, root_watch);
+}
+
+static void
+on_root_parent_changed (GFileMonitor      *monitor,
+                        GFile             *file,
+                        GFile             *other_file,
+                        GFileMonitorEvent  event_type,
+                        RootWatch         *root_watch)
+{
+  GFile *added;
+
+  switch (event_type)
+    {
+    case G_FILE_MONITOR_EVENT_CREATED:
+    case G_FILE_MONITOR_EVENT_MOVED_IN:
+      added = file;
+      break;
+    case G_FILE_MONITOR_EVENT_RENAMED:
+      added = other_file;
+      break;
+    default:
+      return;
+    }
+
+  /* Only the next directory on the way to the root matters */
+  g_autofree char *path = added ? g_file_get_path (added) : NULL;
+  if (path == NULL || !is_under (root_watch->root, path))
+    return;
+
+  /* Frees root_watch */
+  g_autofree char *root = g_strdup (root_watch->root);
+  watch_root (root_watch->index, root);
+}
+
+static void on_crawl_done (GObject      *source_object,
+                           GAsyncResult *result,
+                           gpointer      user_data);
+
+static void
+crawl (ProjectIndex *self)
+{
+  if (self->crawling != NULL || g_hash_table_size (self->pending) == 0)
+    return;
+
+  GPtrArray *starts = g_ptr_array_new_with_free_func (crawl_job_free);
+  GHashTableIter iter;
+  const char *path;
+  gpointer depth;
+
+  /* Crawling a directory also covers everything inside it */
+  g_hash_table_iter_init (&iter, self->pending);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&path, &depth))
+    {
+      GHashTableIter other_iter;
+      const char *other;
+      gboolean covered = FALSE;
+
+      g_hash_table_iter_init (&other_iter, self->pending);
+      while (!covered && g_hash_table_iter_next (&other_iter, (gpointer *)&other, NULL))
+        covered = other != path && is_under (path, other);
+
+      if (!covered)
+        g_ptr_array_add (starts, crawl_job_new (path, GPOINTER_TO_INT (depth)));
+    }
+  g_hash_table_remove_all (self->pending);
+
+  self->crawling = g_ptr_array_ref (starts);
+
+  g_autoptr(GTask) task = g_task_new (self, NULL, on_crawl_done, NULL);
+  CrawlData *data = g_new0 (CrawlData, 1);
+  data->starts = starts;
+  data->max_depth = self->max_depth;
+  g_task_set_task_data (task, data, (GDestroyNotify)crawl_data_free);
+  g_task_run_in_thread (task, crawl_thread);
+}
+
+static void
+queue_crawl (ProjectIndex *self,
+             const char   *path,
+             int           depth)
+{
+  g_hash_table_replace (self->pending, g_strdup (path), GINT_TO_POINTER (depth));
+  crawl (self);
+}
+
+static void
+on_crawl_done (GObject      *source_object,
+               GAsyncResult *result,
+               gpointer      user_data)
+{
+  ProjectIndex *self = PROJECT_INDEX (source_object);
+  g_autoptr(GPtrArray) starts = g_steal_pointer (&self->crawling);
+  Crawl *crawl_result = g_task_propagate_pointer (G_TASK (result), NULL);
+  g_autoptr(GHashTable) found = g_hash_table_new (g_str_hash, g_str_equal);
+  gboolean changed = FALSE;
+  GHashTableIter iter;
+  const char *path;
+
+  /* Everything below the starting points was crawled again, so whatever
+   * is there that wasn't found is gone */
+  for (guint i = 0; i < crawl_result->projects->len; i++)
+    g_hash_table_add (found, crawl_result->projects->pdata[i]);
+
+  g_hash_table_iter_init (&iter, self->entries);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&path, NULL))
+    {
+      if (is_under_any (path, starts) && !g_hash_table_contains (found, path))
+        {
+          g_hash_table_iter_remove (&iter);
+          changed = TRUE;
+        }
+    }
+
+  for (guint i = 0; i < crawl_result->projects->len; i++)
+    changed = add_entry (self, crawl_result->projects->pdata[i]) || changed;
+
+  g_hash_table_remove_all (found);
+  for (guint i = 0; i < crawl_result->directories->len; i++)
+    {
+      CrawlJob *dir = crawl_result->directories->pdata[i];
+      g_hash_table_add (found, dir->path);
+    }
+
+  g_hash_table_iter_init (&iter, self->watches);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&path, NULL))
+    {
+      if (is_under_any (path, starts) && !g_hash_table_contains (found, path))
+        g_hash_table_iter_remove (&iter);
+    }
+
+  for (guint i = 0; i < crawl_result->directories->len; i++)
+    {
+      CrawlJob *dir = crawl_result->directories->pdata[i];
+      add_watch (self, dir->path, dir->depth);
+    }
+
+  for (guint i = 0; i < starts->len; i++)
+    {
+      CrawlJob *start = starts->pdata[i];
+      if (start->depth == 0 && !g_hash_table_contains (found, start->path))
+        watch_root (self, start->path);
+    }
+
+  crawl_free (crawl_result);
+
+  if (changed)
+    entries_changed (self);
+
+  crawl (self);
+}
+
+/* Removes the projects and monitors at or below path */
+static gboolean
+remove_below (ProjectIndex *self,
+              const char   *path)
+{
+  gboolean changed = FALSE;
+  GHashTableIter iter;
+  const char *key;
+
+  g_hash_table_iter_init (&iter, self->entries);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&key, NULL))
+    {
+      if (is_under (key, path))
+        {
+          g_hash_table_iter_remove (&iter);
+          changed = TRUE;
+        }
+    }
+
+  g_hash_table_iter_init (&iter, self->pending);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&key, NULL))
+    {
+      if (is_under (key, path))
+        g_hash_table_iter_remove (&iter);
+    }
+
+  g_hash_table_iter_init (&iter, self->watches);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&key, NULL))
+    {
+      if (is_under (key, path))
+        g_hash_table_iter_remove (&iter);
+    }
+
+  return changed;
+}
+
+/* May free watch */
+static gboolean
+child_added (Watch *watch,
+             GFile *file)
+{
+  ProjectIndex *self = watch->index;
+  g_autofree char *path = g_file_get_path (file);
+  g_autofree char *name = g_file_get_basename (file);
+
+  if (path == NULL)
+    return FALSE;
+
+  /* The directory itself became a project, and is no longer searched for
+   * further projects; roots are never projects */
+  if (watch->depth > 0 && (strcmp (name, "pegg.yaml") == 0 || strcmp (name, ".git") == 0))
+    {
+      g_autofree char *dir = g_strdup (watch->path);
+      remove_below (self, dir);
+      add_entry (self, dir);
+      return TRUE;
+    }
+
+  if (name[0] == '.' || watch->depth == self->max_depth)
+    return FALSE;
+
+  GFileType type = g_file_query_file_type (file, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, NULL);
+  if (type == G_FILE_TYPE_SYMBOLIC_LINK)
+    return g_file_test (path, G_FILE_TEST_IS_DIR) && is_project (path) && add_entry (self, path);
+  if (type != G_FILE_TYPE_DIRECTORY)
+    return FALSE;
+
+  if (is_project (path))
+    return add_entry (self, path);
+
+  /* A directory that was moved in can contain projects already, and a new
+   * one needs monitoring for becoming a project */
+  queue_crawl (self, path, watch->depth + 1);
+  return FALSE;
+}
+
+static gboolean
+child_removed (ProjectIndex *self,
+               GFile        *file)
+{
+  g_autofree char *path = g_file_get_path (file);
+  if (path == NULL)
+    return FALSE;
+
+  gboolean changed = remove_below (self, path);
+
+  /* Includes a root's monitor reporting the root itself */
+  for (char **root = self->roots; *root; root++)
+    if (is_under (*root, path) && !g_file_test (*root, G_FILE_TEST_IS_DIR))
+      watch_root (self, *root);
+
+  return changed;
+}
+
+static void
+on_directory_changed (GFileMonitor      *monitor,
+                      GFile             *file,
+                      GFile             *other_file,
+                      GFileMonitorEvent  event_type,
+                      Watch             *watch)
+{
+  ProjectIndex *self = watch->index;
+  gboolean changed = FALSE;
+
+  /* What a running crawl finds here may already be out of date, so look
+   * again once it's done */
+  if (self->crawling != NULL && is_under_any (watch->path, self->crawling))
+    {
+      switch (event_type)
+        {
+        case G_FILE_MONITOR_EVENT_CREATED:
+        case G_FILE_MONITOR_EVENT_MOVED_IN:
+        case G_FILE_MONITOR_EVENT_DELETED:
+        case G_FILE_MONITOR_EVENT_MOVED_OUT:
+        case G_FILE_MONITOR_EVENT_RENAMED:
+          queue_crawl (self, watch->path, watch->depth);
+          break;
+        default:
+          break;
+        }
+      return;
+    }
+
+  switch (event_type)
+    {
+    case G_FILE_MONITOR_EVENT_CREATED:
+    case G_FILE_MONITOR_EVENT_MOVED_IN:
+      changed = child_added (watch, file);
+      break;
+    case G_FILE_MONITOR_EVENT_DELETED:
+    case G_FILE_MONITOR_EVENT_MOVED_OUT:
+      changed = child_removed (self, file);
+      break;
+    case G_FILE_MONITOR_EVENT_RENAMED:
+      changed = child_removed (self, file);
+      if (other_file != NULL)
+        changed = child_added (watch, other_file) || changed;
+      break;
+    default:
+      break;
+    }
+
+  if (changed)
+    entries_changed (self);
+}
+
+static void
+project_index_constructed (GObject *object)
+{
+  ProjectIndex *self = PROJECT_INDEX (object);
+
+  g_autofree char *roots = g_strjoinv (";", self->roots);
+  self->signature = g_strdup_printf ("%s;depth=%d", roots, self->max_depth);
+  self->cache_file = g_build_filename (g_get_user_cache_dir (), "PurpleEgg", "projects.index", NULL);
+
+  load_saved_index (self);
+
+  for (char **root = self->roots; *root; root++)
+    g_hash_table_replace (self->pending, g_strdup (*root), GINT_TO_POINTER (0));
+  crawl (self);
+
+  G_OBJECT_CLASS (project_index_parent_class)->constructed (object);
+}
+
+static void
+project_index_finalize (GObject *object)
+{
+  ProjectIndex *self = PROJECT_INDEX (object);
+
+  g_clear_pointer (&self->watches, g_hash_table_destroy);
+  g_clear_pointer (&self->root_watches, g_hash_table_destroy);
+  g_clear_pointer (&self->pending, g_hash_table_destroy);
+  g_clear_pointer (&self->roots, g_strfreev);
+  g_free (self->signature);
+  g_free (self->cache_file);
+  g_clear_pointer (&self->entries, g_hash_table_destroy);
+  g_clear_pointer (&self->snapshot, g_ptr_array_unref);
+
+  G_OBJECT_CLASS (project_index_parent_class)->finalize (object);
+}
+
+static void
+project_index_get_property (GObject    *object,
+                            guint       prop_id,
+                            GValue     *value,
+                            GParamSpec *pspec)
+{
+  ProjectIndex *self = PROJECT_INDEX (object);
+
+  switch (prop_id)
+    {
+    case PROP_ROOTS:
+      g_value_set_boxed (value, self->roots);
+      break;
+    case PROP_MAX_DEPTH:
+      g_value_set_int (value, self->max_depth);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+project_index_set_property (GObject      *object,
+                            guint         prop_id,
+                            const GValue *value,
+                            GParamSpec   *pspec)
+{
+  ProjectIndex *self = PROJECT_INDEX (object);
+
+  switch (prop_id)
+    {
+    case PROP_ROOTS:
+      self->roots = g_value_dup_boxed (value);
+      break;
+    case PROP_MAX_DEPTH:
+      self->max_depth = g_value_get_int (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+project_index_class_init (ProjectIndexClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->constructed = project_index_constructed;
+  object_class->finalize = project_index_finalize;
+  object_class->get_property = project_index_get_property;
+  object_class->set_property = project_index_set_property;
+
+  properties[PROP_ROOTS] =
+        g_param_spec_boxed ("roots",
+                            "Roots",
+                            "Directories to look for projects in",
+                            G_TYPE_STRV,
+                            (G_PARAM_CONSTRUCT_ONLY |
+                             G_PARAM_READWRITE |
+                             G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (object_class, PROP_ROOTS,
+                                   properties [PROP_ROOTS]);
+
+  properties[PROP_MAX_DEPTH] =
+        g_param_spec_int ("max-depth",
+                          "Max Depth",
+                          "How many levels below the roots to look for projects",
+                          1, 16, 3,
+                          (G_PARAM_CONSTRUCT_ONLY |
+                           G_PARAM_READWRITE |
+                           G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (object_class, PROP_MAX_DEPTH,
+                                   properties [PROP_MAX_DEPTH]);
+
+  signals[CHANGED] =
+        g_signal_new ("changed",
+                      G_TYPE_FROM_CLASS (klass),
+                      G_SIGNAL_RUN_LAST,
+                      0, NULL, NULL, NULL,
+                      G_TYPE_NONE, 0);
+}
+
+static void
+project_index_init (ProjectIndex *self)
+{
+  self->watches = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, watch_free);
+  self->root_watches = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, root_watch_free);
+  self->pending = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  self->entries = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         NULL, (GDestroyNotify)project_index_entry_unref);
+}
+
+/* Returns the current entries, as an array of ProjectIndexEntry that
+ * doesn't change when the index changes; unref it when done */
+GPtrArray *
+project_index_get_entries (ProjectIndex *self)
+{
+  if (self->snapshot == NULL)
+    {
+      GHashTableIter iter;
+      ProjectIndexEntry *entry;
+
+      self->snapshot = g_ptr_array_new_full (g_hash_table_size (self->entries),
+                                             (GDestroyNotify)project_index_entry_unref);
+      g_hash_table_iter_init (&iter, self->entries);
+      while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&entry))
+        g_ptr_array_add (self->snapshot, project_index_entry_ref (entry));
+    }
+
+  return g_ptr_array_ref (self->snapshot);
+}
+
+/* Returns the entry for path, or NULL; not referenced */
+ProjectIndexEntry *
+project_index_lookup (ProjectIndex *self,
+                      const char   *path)
+{
+  return g_hash_table_lookup (self->entries, path);
+}
@@ -0,0 +1,35 @@
+#ifndef PROJECT_INDEX_H
+#define PROJECT_INDEX_H
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define PROJECT_TYPE_INDEX (project_index_get_type())
+
+G_DECLARE_FINAL_TYPE (ProjectIndex, project_index, PROJECT, INDEX, GObject)
+
+/* Entries are immutable and reference counted, so they can be handed out
+ * in snapshots while the index changes */
+typedef struct {
+  gint ref_count;
+  char *path;
+  char *name;
+  char *folded_name;
+  gsize folded_name_len;
+} ProjectIndexEntry;
+
+ProjectIndexEntry *project_index_entry_ref   (ProjectIndexEntry *entry);
+void               project_index_entry_unref (ProjectIndexEntry *entry);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (ProjectIndexEntry, project_index_entry_unref)
+
+ProjectIndex      *project_index_new           (const char *const *roots,
+                                                int                max_depth);
+GPtrArray         *project_index_get_entries   (ProjectIndex *index);
+ProjectIndexEntry *project_index_lookup        (ProjectIndex *index,
+                                                const char   *path);
+
+G_END_DECLS
+
+#endif /* PROJECT_INDEX_H */
@@ -0,0 +1,161 @@
+#include <string.h>
+
+#include "project-matcher.h"
+
+/* Ranks project names against search terms. Names are matched in their
+ * casefolded form, which the project index computes once per project,
+ * so matching is just byte comparisons. Candidate positions are found
+ * with memchr(), which libc implements with vector instructions, so
+ * names that can't match are skipped over quickly; UTF-8 is
+ * self-synchronizing, so this also works for non-ASCII names as long as
+ * whole characters are compared.
+ *
+ * Each term must match; in decreasing order of score, as a prefix of the
+ * name, at the start of a word, anywhere in the name, or as a
+ * subsequence of its characters. Among equal matches, shorter names are
+ * ranked first.
+ */
+
+#define SCORE_PREFIX      3000
+#define SCORE_WORD_START  2000
+#define SCORE_SUBSTRING   1000
+#define SCORE_SUBSEQUENCE  500
+
+typedef struct {
+  char *text;
+  gsize len;
+} Term;
+
+struct _ProjectMatcher {
+  Term *terms;
+  int n_terms;
+};
+
+ProjectMatcher *
+project_matcher_new (const char *const *terms)
+{
+  ProjectMatcher *matcher = g_new0 (ProjectMatcher, 1);
+
+  matcher->n_terms = g_strv_length ((char **)terms);
+  matcher->terms = g_new0 (Term, matcher->n_terms);
+  for (int i = 0; i < matcher->n_terms; i++)
+    {
+      matcher->terms[i].text = g_utf8_casefold (terms[i], -1);
+      matcher->terms[i].len = strlen (matcher->terms[i].text);
+    }
+
+  return matcher;
+}
+
+void
+project_matcher_free (ProjectMatcher *matcher)
+{
+  for (int i = 0; i < matcher->n_terms; i++)
+    g_free (matcher->terms[i].text);
+  g_free (matcher->terms);
+  g_free (matcher);
+}
+
+static gboolean
+is_word_start (const char *name,
+               const char *p)
+{
+  return p == name || strchr ("-_. ", p[-1]) != NULL;
+}
+
+/* Finds the len bytes at needle in [start, end) */
+static const char *
+find_bytes (const char *start,
+            const char *end,
+            const char *needle,
+            gsize       len)
+{
+  const char *p = start;
+
+  while (p + len <= end)
+    {
+      p = memchr (p, needle[0], end - p);
+      if (p == NULL || p + len > end)
+        return NULL;
+      if (memcmp (p + 1, needle + 1, len - 1) == 0)
+        return p;
+      p++;
+    }
+
+  return NULL;
+}
+
+static int
+score_subsequence (const Term *term,
+                   const char *name,
+                   gsize       len)
+{
+  const char *end = name + len;
+  const char *p = name;
+  int score = SCORE_SUBSEQUENCE;
+
+  for (const char *t = term->text; *t; t = g_utf8_next_char (t))
+    {
+      gsize char_len = g_utf8_skip[*(const guchar *)t];
+      const char *found = find_bytes (p, end, t, char_len);
+      if (found == NULL)
+        return -1;
+
+      /* Prefer matches that are close together and start words */
+      score -= found - p;
+      if (is_word_start (name, found))
+        score += 10;
+
+      p = found + char_len;
+    }
+
+  return CLAMP (score, 1, SCORE_SUBSTRING - 1);
+}
+
+static int
+score_term (const Term *term,
+            const char *name,
+            gsize       len)
+{
+  if (term->len == 0)
+    return SCORE_PREFIX;
+
+  int best = -1;
+  const char *end = name + len;
+  const char *p = name;
+  while ((p = find_bytes (p, end, term->text, term->len)) != NULL)
+    {
+      if (p == name)
+        return SCORE_PREFIX;
+      if (is_word_start (name, p))
+        return SCORE_WORD_START;
+
+      best = SCORE_SUBSTRING;
+      p++;
+    }
+
+  if (best >= 0)
+    return best;
+
+  return score_subsequence (term, name, len);
+}
+
+/* Returns a score >= 0 if all terms match folded_name, higher for better
+ * matches, or -1 if it doesn't match */
+int
+project_matcher_score (ProjectMatcher *matcher,
+                       const char     *folded_name,
+                       gsize           folded_name_len)
+{
+  int score = 0;
+
+  for (int i = 0; i < matcher->n_terms; i++)
+    {
+      int term_score = score_term (&matcher->terms[i], folded_name, folded_name_len);
+      if (term_score < 0)
+        return -1;
+      score += term_score;
+    }
+
+  return score * 256 + (255 - (int) MIN (folded_name_len, 255));
+}
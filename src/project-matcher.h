@@ -0,0 +1,20 @@
+#ifndef PROJECT_MATCHER_H
+#define PROJECT_MATCHER_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _ProjectMatcher ProjectMatcher;
+
+ProjectMatcher *project_matcher_new   (const char *const *terms);
+void            project_matcher_free  (ProjectMatcher    *matcher);
+int             project_matcher_score (ProjectMatcher    *matcher,
+                                       const char        *folded_name,
+                                       gsize              folded_name_len);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (ProjectMatcher, project_matcher_free)
+
+G_END_DECLS
+
+#endif /* PROJECT_MATCHER_H */
@@ -0,0 +1,217 @@
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "project-meta-cache.h"
+
+/* Details about projects shown in search results. Lookups only read the
+ * in-memory cache; entries are computed and revalidated in a worker
+ * thread, by comparing the modification times of the project directory
+ * (which changes when pegg.yaml is added or removed), of .git/HEAD
+ * (which changes when switching branches), and of .git/index (which
+ * changes when committing, staging, or checking out). Entries for
+ * projects that have gone away are dropped.
+ */
+struct _ProjectMetaCache
+{
+  GObject parent_instance;
+  GHashTable *metas; /* path => ProjectMeta */
+};
+
+G_DEFINE_TYPE (ProjectMetaCache, project_meta_cache, G_TYPE_OBJECT)
+
+typedef struct {
+  char *path;
+  gint64 mtime;          /* -1 if not cached */
+  gint64 git_head_mtime;
+  gint64 git_index_mtime;
+} UpdateRequest;
+
+static void
+project_meta_free (ProjectMeta *meta)
+{
+  g_free (meta->path);
+  g_free (meta->name);
+  g_free (meta->git_branch);
+  g_free (meta);
+}
+
+ProjectMetaCache *
+project_meta_cache_new (void)
+{
+  return g_object_new (PROJECT_TYPE_META_CACHE, NULL);
+}
+
+static void
+project_meta_cache_finalize (GObject *object)
+{
+  ProjectMetaCache *self = PROJECT_META_CACHE (object);
+
+  g_clear_pointer (&self->metas, g_hash_table_destroy);
+
+  G_OBJECT_CLASS (project_meta_cache_parent_class)->finalize (object);
+}
+
+static void
+project_meta_cache_class_init (ProjectMetaCacheClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = project_meta_cache_finalize;
+}
+
+static void
+project_meta_cache_init (ProjectMetaCache *self)
+{
+  self->metas = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                       NULL, (GDestroyNotify)project_meta_free);
+}
+
+/* Returns the cached meta for path, or NULL; valid until the next
+ * update completes */
+const ProjectMeta *
+project_meta_cache_lookup (ProjectMetaCache *self,
+                           const char       *path)
+{
+  return g_hash_table_lookup (self->metas, path);
+}
+
+static gint64
+get_mtime (const char *path)
+{
+  GStatBuf buf;
+
+  if (g_stat (path, &buf) != 0)
+    return -1;
+
+  return buf.st_mtime;
+}
+
+/* Reads the branch from .git/HEAD rather than running git. Not from the
+ * project view's probe cache, which can be older than HEAD. */
+static char *
+read_git_branch (const char *path)
+{
+  g_autofree char *head_file = g_build_filename (path, ".git", "HEAD", NULL);
+  g_autofree char *contents = NULL;
+  if (!g_file_get_contents (head_file, &contents, NULL, NULL))
+    return NULL;
+
+  g_strchomp (contents);
+  if (!g_str_has_prefix (contents, "ref: refs/heads/"))
+    return NULL;
+
+  return g_strdup (contents + strlen ("ref: refs/heads/"));
+}
+
+static void
+update_thread (GTask        *task,
+               gpointer      source_object,
+               gpointer      task_data,
+               GCancellable *cancellable)
+{
+  GArray *requests = task_data;
+  GPtrArray *updated = g_ptr_array_new_with_free_func ((GDestroyNotify)project_meta_free);
+
+  for (guint i = 0; i < requests->len; i++)
+    {
+      UpdateRequest *request = &g_array_index (requests, UpdateRequest, i);
+      gint64 mtime = get_mtime (request->path);
+      if (mtime < 0)
+        {
+          /* A meta without a name tells the main thread to drop it */
+          if (request->mtime >= 0)
+            {
+              ProjectMeta *meta = g_new0 (ProjectMeta, 1);
+              meta->path = g_strdup (request->path);
+              g_ptr_array_add (updated, meta);
+            }
+          continue;
+        }
+
+      g_autofree char *git_head = g_build_filename (request->path, ".git", "HEAD", NULL);
+      g_autofree char *git_index = g_build_filename (request->path, ".git", "index", NULL);
+      gint64 git_head_mtime = get_mtime (git_head);
+      gint64 git_index_mtime = get_mtime (git_index);
+      if (mtime == request->mtime &&
+          git_head_mtime == request->git_head_mtime &&
+          git_index_mtime == request->git_index_mtime)
+        continue;
+
+      g_autofree char *pegg_yaml = g_build_filename (request->path, "pegg.yaml", NULL);
+
+      ProjectMeta *meta = g_new0 (ProjectMeta, 1);
+      meta->path = g_strdup (request->path);
+      meta->name = g_path_get_basename (request->path);
+      meta->git_branch = read_git_branch (request->path);
+      meta->has_container = g_file_test (pegg_yaml, G_FILE_TEST_EXISTS);
+      meta->mtime = mtime;
+      meta->git_head_mtime = git_head_mtime;
+      meta->git_index_mtime = git_index_mtime;
+      meta->modified = MAX (mtime, git_index_mtime);
+      g_ptr_array_add (updated, meta);
+    }
+
+  g_task_return_pointer (task, updated, (GDestroyNotify)g_ptr_array_unref);
+}
+
+static void
+update_request_clear (UpdateRequest *request)
+{
+  g_free (request->path);
+}
+
+/* Computes metas that aren't cached, and refreshes ones that are out
+ * of date, in a worker thread */
+void
+project_meta_cache_update_async (ProjectMetaCache    *self,
+                                 const char *const   *paths,
+                                 GAsyncReadyCallback  callback,
+                                 gpointer             user_data)
+{
+  g_autoptr(GTask) task = g_task_new (self, NULL, callback, user_data);
+  GArray *requests = g_array_new (FALSE, FALSE, sizeof (UpdateRequest));
+  g_array_set_clear_func (requests, (GDestroyNotify)update_request_clear);
+
+  for (const char *const *path = paths; *path; path++)
+    {
+      const ProjectMeta *meta = project_meta_cache_lookup (self, *path);
+      UpdateRequest request = {
+        g_strdup (*path),
+        meta ? meta->mtime : -1,
+        meta ? meta->git_head_mtime : -1,
+        meta ? meta->git_index_mtime : -1
+      };
+      g_array_append_val (requests, request);
+    }
+
+  g_task_set_task_data (task, requests, (GDestroyNotify)g_array_unref);
+  g_task_run_in_thread (task, update_thread);
+}
+
+gboolean
+project_meta_cache_update_finish (ProjectMetaCache  *self,
+                                  GAsyncResult      *result,
+                                  GError           **error)
+{
+  g_autoptr(GPtrArray) updated = g_task_propagate_pointer (G_TASK (result), error);
+  if (updated == NULL)
+    return FALSE;
+
+  /* Take the metas out of the array without freeing them */
+  g_ptr_array_set_free_func (updated, NULL);
+  for (guint i = 0; i < updated->len; i++)
+    {
+      ProjectMeta *meta = updated->pdata[i];
+      if (meta->name == NULL)
+        {
+          g_hash_table_remove (self->metas, meta->path);
+          project_meta_free (meta);
+        }
+      else
+        {
+          g_hash_table_replace (self->metas, meta->path, meta);
+        }
+    }
+
+  return TRUE;
+}
@@ -0,0 +1,38 @@
+#ifndef PROJECT_META_CACHE_H
+#define PROJECT_META_CACHE_H
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define PROJECT_TYPE_META_CACHE (project_meta_cache_get_type())
+
+G_DECLARE_FINAL_TYPE (ProjectMetaCache, project_meta_cache, PROJECT, META_CACHE, GObject)
+
+typedef struct {
+  char *path;
+  char *name;
+  char *git_branch; /* NULL if not a git checkout or not on a branch */
+  gboolean has_container;
+  /* The later of the project directory and .git/index; editing a file
+   * doesn't count until it's staged or committed */
+  gint64 modified;
+  gint64 mtime;
+  gint64 git_head_mtime;
+  gint64 git_index_mtime;
+} ProjectMeta;
+
+ProjectMetaCache  *project_meta_cache_new           (void);
+const ProjectMeta *project_meta_cache_lookup        (ProjectMetaCache    *cache,
+                                                     const char          *path);
+void               project_meta_cache_update_async  (ProjectMetaCache    *cache,
+                                                     const char *const   *paths,
+                                                     GAsyncReadyCallback  callback,
+                                                     gpointer             user_data);
+gboolean           project_meta_cache_update_finish (ProjectMetaCache    *cache,
+                                                     GAsyncResult        *result,
+                                                     GError             **error);
+
+G_END_DECLS
+
+#endif /* PROJECT_META_CACHE_H */
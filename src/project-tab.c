@@ -1,10 +1,15 @@
 #include "project-tab.h"
+#include "startup-timeline.h"
 #include <vte/vte.h>
 #include <sys/ioctl.h>
 #include <termios.h>
 #include <fcntl.h>
 #include <unistd.h>
 
+/* What pegg shell --wait-for-directory sets the title to once it has
+ * turned off echo and is reading the directory */
+#define WARM_READY_TITLE "pegg-warm-ready"
+
 struct _ProjectTab
 {
   GtkBox parent_instance;
@@ -12,6 +17,7 @@ struct _ProjectTab
   GtkWidget *vte;
   char *directory;
   char *title;
+  gboolean ready;
 };
 
 G_DEFINE_TYPE (ProjectTab, project_tab, GTK_TYPE_BOX)
@@ -113,6 +119,9 @@ child_setup (gpointer user_data)
 #endif
 }
 
+static void on_contents_changed (VteTerminal *vte,
+                                 ProjectTab  *self);
+
 static void
 project_tab_constructed (GObject *object)
 {
@@ -133,10 +142,20 @@ project_tab_constructed (GObject *object)
   const char *terminal_envv[] = { "PURPLEEGG=1", NULL };
   GError *error = NULL;
 
+  /* A warm tab, without a directory yet, gets as far as pegg shell, which
+   * then waits for project_tab_adopt() to send the directory; only
+   * starting the environment for the project is left. */
+  const char *warm_argv[] = {
+    "/bin/bash", "-l", "-c", "exec " BINDIR "/pegg shell --wait-for-directory", NULL
+  };
+
+  /* A warm tab is started ahead of time in resident mode, so its spawn
+   * isn't part of opening a window */
+  startup_timeline_mark (self->directory ? "spawn start" : "warm spawn start");
   vte_terminal_spawn_sync (VTE_TERMINAL (self->vte),
                            VTE_PTY_DEFAULT,
-                           self->directory,
-                           (char **)terminal_argv,
+                           self->directory ? self->directory : g_get_home_dir (),
+                           self->directory ? (char **)terminal_argv : (char **)warm_argv,
                            (char **)terminal_envv,
                            G_SPAWN_DEFAULT,
                            child_setup, /* child_setup */
@@ -144,6 +163,12 @@ project_tab_constructed (GObject *object)
                            NULL, /* child_pid_out */
                            NULL, /* cancellable */
                            &error);
+  startup_timeline_mark (self->directory ? "spawn end" : "warm spawn end");
+
+  /* The first output of a warm tab only comes once a project is picked */
+  if (self->directory != NULL)
+    g_signal_connect (self->vte, "contents-changed",
+                      G_CALLBACK (on_contents_changed), self);
 }
 
 static void
@@ -206,10 +231,19 @@ on_child_exited (VteTerminal   *vte,
                  int            status,
                  ProjectTab    *self)
 {
-  if (status == 0)
+  /* A warm tab is no use without its shell */
+  if (status == 0 || self->directory == NULL)
     gtk_widget_destroy (GTK_WIDGET (self));
 }
 
+static void
+on_contents_changed (VteTerminal *vte,
+                     ProjectTab  *self)
+{
+  startup_timeline_mark ("first output");
+  g_signal_handlers_disconnect_by_func (vte, on_contents_changed, self);
+}
+
 static void
 on_current_directory_uri_changed (VteTerminal *vte)
 {
@@ -222,6 +256,14 @@ on_window_title_changed (VteTerminal *vte,
                          ProjectTab  *self)
 {
   const char *title = vte_terminal_get_window_title (vte);
+
+  if (self->directory == NULL && g_strcmp0 (title, WARM_READY_TITLE) == 0)
+    {
+      self->ready = TRUE;
+      startup_timeline_finish ("warm tab ready");
+      return;
+    }
+
   g_free (self->title);
   self->title = g_strdup (title);
   g_signal_emit (self, signals[TITLE_CHANGED], 0);
@@ -282,6 +324,29 @@ project_tab_init (ProjectTab *self)
                     G_CALLBACK(on_window_title_changed), self);
 }
 
+/* Whether a tab created without a directory is waiting for one; before
+ * that, what's sent to it could still be echoed */
+gboolean
+project_tab_get_ready (ProjectTab *self)
+{
+  return self->ready;
+}
+
+/* Starts the shell of a ready tab created without a directory in
+ * directory */
+void
+project_tab_adopt (ProjectTab *self,
+                   const char *directory)
+{
+  g_return_if_fail (self->directory == NULL && self->ready);
+
+  self->directory = g_strdup (directory);
+  g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_DIRECTORY]);
+
+  g_autofree char *line = g_strconcat (directory, "\n", NULL);
+  vte_terminal_feed_child (VTE_TERMINAL (self->vte), line, -1);
+}
+
 void
 project_tab_set_font_scale (ProjectTab *self,
                             double      font_scale)
@@ -9,7 +9,10 @@ G_BEGIN_DECLS
 
 G_DECLARE_FINAL_TYPE (ProjectTab, project_tab, PROJECT, TAB, GtkBox)
 
-ProjectTab *project_tab_new (const char *directory);
+ProjectTab *project_tab_new       (const char *directory);
+gboolean    project_tab_get_ready (ProjectTab *tab);
+void        project_tab_adopt     (ProjectTab *tab,
+                                   const char *directory);
 
 void        project_tab_set_font_scale (ProjectTab *tab,
                                         double      font_scale);
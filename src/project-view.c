@@ -1,8 +1,10 @@
 #include <string.h>
 
 #include "host-command.h"
+#include "probe-cache.h"
 #include "project-tab.h"
 #include "project-view.h"
+#include "startup-timeline.h"
 
 struct _ProjectView
 {
@@ -156,21 +158,57 @@ get_git_branch (ProjectView   *self,
     return NULL;
 }
 
+/* The git state is cached with the probe cache, shared with other
+ * windows and the search provider; the monitors invalidate it */
+#define GIT_CACHE_TTL 60
+
+static char *
+get_git_cache_prefix (ProjectView *self)
+{
+  return g_strconcat ("git:", self->directory, ":", NULL);
+}
+
 static void
 update_git (ProjectView *self)
 {
   GError *error = NULL;
+  g_autofree char *prefix = get_git_cache_prefix (self);
+  g_autofree char *branches_key = g_strconcat (prefix, "branches", NULL);
+  g_autofree char *head_key = g_strconcat (prefix, "head", NULL);
 
-  g_auto(GStrv) branches = list_git_branches (self, &error);
-  if (error)
+  g_auto(GStrv) branches = NULL;
+  g_autofree char *cached_branches = pegg_probe_cache_lookup (branches_key);
+  if (cached_branches)
     {
-      g_clear_error (&error);
-      gtk_widget_hide (GTK_WIDGET (self->git_combo));
-      return;
+      branches = g_strsplit (cached_branches, "\n", -1);
+    }
+  else
+    {
+      branches = list_git_branches (self, &error);
+      if (error)
+        {
+          g_clear_error (&error);
+          gtk_widget_hide (GTK_WIDGET (self->git_combo));
+          return;
+        }
+
+      g_autofree char *joined = g_strjoinv ("\n", branches);
+      pegg_probe_cache_store (branches_key, joined, GIT_CACHE_TTL);
+    }
+
+  /* An empty cached value means there is no current branch */
+  g_autofree char *current_branch = pegg_probe_cache_lookup (head_key);
+  if (current_branch == NULL)
+    {
+      current_branch = get_git_branch (self, &error);
+      if (error)
+        g_clear_error (&error);
+      pegg_probe_cache_store (head_key, current_branch ? current_branch : "", GIT_CACHE_TTL);
+    }
+  else if (current_branch[0] == '\0')
+    {
+      g_clear_pointer (&current_branch, g_free);
     }
-  g_autofree char *current_branch  = get_git_branch (self, &error);
-  if (error)
-    g_clear_error (&error);
 
   g_free (self->current_git_branch);
   self->current_git_branch = g_strdup (current_branch);
@@ -193,6 +231,9 @@ on_git_changed (GFileMonitor      *monitor,
                 GFileMonitorEvent  event_type,
                 ProjectView       *self)
 {
+  g_autofree char *prefix = get_git_cache_prefix (self);
+  pegg_probe_cache_invalidate (prefix);
+
   update_git (self);
 }
 
@@ -453,7 +494,11 @@ on_title_changed (ProjectTab  *tab,
 static void
 new_tab (ProjectView *self)
 {
-  ProjectTab *tab = project_tab_new (self->directory);
+  ProjectApplication *application = PROJECT_APPLICATION (gtk_window_get_application (GTK_WINDOW (self->window)));
+  g_autoptr(ProjectTab) tab = project_application_take_warm_tab (application, self->directory);
+  if (tab == NULL)
+    tab = g_object_ref_sink (project_tab_new (self->directory));
+
   project_tab_set_font_scale (tab, self->font_scale);
   gtk_widget_show (GTK_WIDGET (tab));
   gtk_container_add (GTK_CONTAINER (self->stack), GTK_WIDGET (tab));
@@ -566,6 +611,7 @@ project_view_init (ProjectView *self)
   self->columns = 80;
 
   gtk_widget_init_template (GTK_WIDGET (self));
+  startup_timeline_mark ("view template");
 
   g_signal_connect (self->git_combo, "changed",
                     G_CALLBACK (on_git_combo_changed), self);
@@ -6,6 +6,7 @@
 #include "project-creator.h"
 #include "project-greeter.h"
 #include "project-window.h"
+#include "startup-timeline.h"
 
 struct _ProjectWindow
 {
@@ -114,10 +115,31 @@ project_window_class_init (ProjectWindowClass *klass)
                                    properties [PROP_DIRECTORY]);
 }
 
+static void
+on_after_paint (GdkFrameClock *frame_clock,
+                ProjectWindow *self)
+{
+  /* At the greeter, nothing more happens until a project is picked */
+  if (self->directory == NULL)
+    startup_timeline_finish ("first frame");
+  else
+    startup_timeline_mark ("first frame");
+  g_signal_handlers_disconnect_by_func (frame_clock, on_after_paint, self);
+}
+
+static void
+on_realize (GtkWidget *widget)
+{
+  g_signal_connect (gtk_widget_get_frame_clock (widget), "after-paint",
+                    G_CALLBACK (on_after_paint), widget);
+}
+
 static void
 project_window_init (ProjectWindow *self)
 {
   gtk_window_set_title (GTK_WINDOW (self), "PurpleEgg");
+
+  g_signal_connect (self, "realize", G_CALLBACK (on_realize), NULL);
 }
 
 const char *
@@ -163,6 +185,11 @@ project_window_set_directory (ProjectWindow *self,
       g_autofree char *basename = g_path_get_basename (self->directory);
       gtk_window_set_title (GTK_WINDOW (self), basename);
 
+      GtkApplication *application = gtk_window_get_application (GTK_WINDOW (self));
+      if (application != NULL)
+        project_frecency_record (project_application_get_frecency (PROJECT_APPLICATION (application)),
+                                 self->directory);
+
       ProjectView *view = project_view_new (self, directory);
       gtk_widget_show (GTK_WIDGET (view));
 
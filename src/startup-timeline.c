@@ -0,0 +1,142 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "startup-timeline.h"
+
+/* Records when the steps of starting up happen - the first time each
+ * mark is hit - and prints them with the time between them once both
+ * the first frame has been painted and the first shell output has
+ * arrived, or startup ends some other way (startup_timeline_finish()),
+ * such as at a greeter, where what happens next waits for the user.
+ * Nothing is recorded after that. Marks are always recorded, since
+ * that's cheap; printing is enabled by PURPLEEGG_STARTUP_TIMELINE=1 or
+ * --startup-timeline.
+ *
+ * Times are from CLOCK_BOOTTIME, so that they can be compared with the
+ * start time of the process from /proc/self/stat; that has a resolution
+ * of a clock tick, usually 10ms.
+ */
+#define MAX_MARKS 16
+
+typedef struct {
+  const char *name;
+  gint64 time; /* microseconds */
+} Mark;
+
+static Mark marks[MAX_MARKS];
+static int n_marks;
+static gboolean enabled;
+static gboolean finished;
+
+static gint64
+now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_BOOTTIME, &ts);
+  return (gint64)ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+static gint64
+get_process_start (void)
+{
+  g_autofree char *contents = NULL;
+  if (!g_file_get_contents ("/proc/self/stat", &contents, NULL, NULL))
+    return -1;
+
+  /* The command name, in parentheses, can contain spaces */
+  const char *p = strrchr (contents, ')');
+  if (p == NULL)
+    return -1;
+
+  /* After the command name comes field 3; starttime is field 22 */
+  g_auto(GStrv) fields = g_strsplit (p + 2, " ", -1);
+  if (g_strv_length (fields) < 20)
+    return -1;
+
+  guint64 ticks = g_ascii_strtoull (fields[19], NULL, 10);
+  return ticks * G_USEC_PER_SEC / sysconf (_SC_CLK_TCK);
+}
+
+static const Mark *
+find_mark (const char *name)
+{
+  for (int i = 0; i < n_marks; i++)
+    {
+      if (strcmp (marks[i].name, name) == 0)
+        return &marks[i];
+    }
+
+  return NULL;
+}
+
+static int
+compare_marks (const void *a,
+               const void *b)
+{
+  const Mark *mark_a = a;
+  const Mark *mark_b = b;
+
+  return mark_a->time < mark_b->time ? -1 : (mark_a->time > mark_b->time ? 1 : 0);
+}
+
+static void
+print_timeline (void)
+{
+  Mark sorted[MAX_MARKS + 1];
+  int n_sorted = 0;
+
+  gint64 process_start = get_process_start ();
+  if (process_start >= 0)
+    sorted[n_sorted++] = (Mark) { "process start", process_start };
+
+  memcpy (sorted + n_sorted, marks, n_marks * sizeof (Mark));
+  n_sorted += n_marks;
+  qsort (sorted, n_sorted, sizeof (Mark), compare_marks);
+
+  g_printerr ("Startup timeline (ms since start, since previous):\n");
+  for (int i = 0; i < n_sorted; i++)
+    {
+      g_printerr ("  %-20s %8.1f %8.1f\n",
+                  sorted[i].name,
+                  (sorted[i].time - sorted[0].time) / 1000.,
+                  i > 0 ? (sorted[i].time - sorted[i - 1].time) / 1000. : 0.);
+    }
+}
+
+void
+startup_timeline_enable (void)
+{
+  enabled = TRUE;
+}
+
+/* Marks name as the last step of startup, and prints the timeline */
+void
+startup_timeline_finish (const char *name)
+{
+  if (finished)
+    return;
+
+  startup_timeline_mark (name);
+
+  finished = TRUE;
+  if (enabled || g_strcmp0 (g_getenv ("PURPLEEGG_STARTUP_TIMELINE"), "1") == 0)
+    print_timeline ();
+}
+
+/* Records the first time name is reached; name must be a static string */
+void
+startup_timeline_mark (const char *name)
+{
+  if (finished || n_marks == MAX_MARKS || find_mark (name) != NULL)
+    return;
+
+  marks[n_marks].name = name;
+  marks[n_marks].time = now ();
+  n_marks++;
+
+  if (find_mark ("first frame") && find_mark ("first output"))
+    startup_timeline_finish (name);
+}
@@ -0,0 +1,14 @@
+#ifndef STARTUP_TIMELINE_H
+#define STARTUP_TIMELINE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+void startup_timeline_enable (void);
+void startup_timeline_mark   (const char *name);
+void startup_timeline_finish (const char *name);
+
+G_END_DECLS
+
+#endif /* STARTUP_TIMELINE_H */